@@ -12,37 +12,24 @@
 #include "mandelbrot.hpp"
 #include "mandelbrot_image.hpp"
 #include "mandelbrot_video.hpp"
+#include "mandelbrot_explorer.hpp"
 
 
 using namespace std;
 
-void show_openmp(){
-    // test if openmp is available/used
-    #pragma omp parallel
-    {
-        int thread_id = omp_get_thread_num();
-        int total_threads = omp_get_num_threads();
-        #pragma omp critical
-        {
-            cout << "Hello from thread " << thread_id << " of " << total_threads << endl;
-        }
-    }
-}
-
-
 int main() {
     // do we have intel optimisations there, and ffmpeg enabled?
     // std::cout << "Available backends: " << cv::getBuildInformation() << std::endl;
-    // openmp enabled?
-    // show_openmp();
 
     Settings settings;
     settings.loadFromYaml("settings.yaml");
 
     unique_ptr<Mandelbrot> renderer;
 
-    // Instantiate based on settings.animate
-    if (settings.animate) {
+    // Instantiate based on settings.interactive and settings.animate
+    if (settings.interactive) {
+        renderer = make_unique<MandelbrotExplorer>(&settings);
+    } else if (settings.animate) {
         renderer = make_unique<MandelbrotVideo>(&settings);
     } else {
         renderer = make_unique<MandelbrotImage>(&settings);
@@ -0,0 +1,36 @@
+#include <iostream>
+
+#include "settings.hpp"
+#include "iteration_archive.hpp"
+#include "mandelbrot_recolor.hpp"
+
+
+using namespace std;
+
+/**
+ * Recolor a rendered video from its iteration archive (settings.iteration_archive),
+ * with the colormap and color_cycle of settings.yaml.
+ */
+int main() {
+    Settings settings;
+    settings.loadFromYaml("settings.yaml");
+
+    if (settings.iteration_archive.empty()) {
+        cerr << "Set iteration_archive in settings.yaml to the archive to recolor" << endl;
+        return 1;
+    }
+
+    IterationArchiveReader archive(settings.iteration_archive);
+    if (!archive.is_open()) {
+        return 1;
+    }
+
+    // the resolution is that of the archive
+    settings.x_resolution = archive.get_nx();
+    settings.y_resolution = archive.get_ny();
+
+    MandelbrotRecolor recolor(&settings, &archive);
+    recolor.run();
+
+    return 0;
+}
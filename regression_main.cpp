@@ -0,0 +1,29 @@
+#include <fstream>
+#include <iostream>
+
+#include "settings.hpp"
+#include "mandelbrot_regression.hpp"
+
+
+using namespace std;
+
+// the gate has its own settings next to the golden buffers, so editing settings.yaml for a render does not move it
+static const string regression_settings = "golden/regression.yaml";
+
+/**
+ * Renders the reference scenes with every kernel variant and compares them to the golden iteration buffers.
+ * Returns non-zero if a variant produces a different picture, so it can gate a merge.
+ */
+int main() {
+    if (!ifstream(regression_settings)) {
+        cerr << "No " << regression_settings << ", run from the source tree" << endl;
+        return 1;
+    }
+    Settings settings;
+    settings.loadFromYaml(regression_settings);
+
+    MandelbrotRegression regression(&settings);
+    regression.run();
+
+    return regression.passed() ? 0 : 1;
+}
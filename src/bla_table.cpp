@@ -0,0 +1,77 @@
+#include "bla_table.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static const double bailout = 4.0;
+
+// precision of the reference orbit: quad where the compiler has it (gcc, clang; software arithmetic, only + - *),
+// else long double, which is already quad on aarch64 linux and only a double with MSVC
+#if defined(__SIZEOF_FLOAT128__)
+using orbit_float = __float128;
+#else
+using orbit_float = long double;
+#endif
+
+
+void BlaTable::build(double cx, double cy, int max_its, double dc_max) {
+    this->cx = cx;
+    this->cy = cy;
+
+    // reference orbit; the point after the last step is kept as well, even if it escaped, so every step has a Z_{m+1}.
+    // The rounding errors of the orbit grow along it like a deviation dz does, and the pixels are only a dz of about
+    // the pixel size away: iterated in orbit_float, stored rounded to double
+    zx.assign(1, 0.0);
+    zy.assign(1, 0.0);
+    orbit_float x = 0.0, y = 0.0;
+    for (int n = 0; n < max_its; ++n) {
+        orbit_float x_new = x * x - y * y + cx;
+        y = 2 * x * y + cy;
+        x = x_new;
+        zx.push_back(static_cast<double>(x));
+        zy.push_back(static_cast<double>(y));
+        if (zx.back() * zx.back() + zy.back() * zy.back() > bailout) {
+            break;
+        }
+    }
+
+    // level 0, one step per reference iteration that has a next one
+    int nr_steps = get_orbit_length() - 1;
+    levels.assign(1, vector<Step>(nr_steps));
+    for (int m = 0; m < nr_steps; ++m) {
+        // dz^2 is negligible compared to 2 Z_m dz for |dz| < epsilon |Z_m|
+        double r = epsilon * sqrt(zx[m] * zx[m] + zy[m] * zy[m]);
+        levels[0][m] = {2.0 * zx[m], 2.0 * zy[m], 1.0, 0.0, r * r, 1};
+    }
+
+    // merge pairs of blocks: first x, then y
+    //      A = A_y A_x,  B = A_y B_x + B_y,  R = min(R_x, max(0, (R_y - |B_x| dc_max) / |A_x|))
+    while (levels.back().size() > 1) {
+        const vector<Step>& below = levels.back();
+        vector<Step> level((below.size() + 1) / 2);
+
+        for (size_t k = 0; k < level.size(); ++k) {
+            const Step& sx = below[2 * k];
+            if (2 * k + 1 == below.size()) {
+                // odd one out at the end of the orbit
+                level[k] = sx;
+                continue;
+            }
+            const Step& sy = below[2 * k + 1];
+
+            Step& step = level[k];
+            step.ax = sy.ax * sx.ax - sy.ay * sx.ay;
+            step.ay = sy.ax * sx.ay + sy.ay * sx.ax;
+            step.bx = sy.ax * sx.bx - sy.ay * sx.by + sy.bx;
+            step.by = sy.ax * sx.by + sy.ay * sx.bx + sy.by;
+            step.length = sx.length + sy.length;
+
+            double ax_abs = sqrt(sx.ax * sx.ax + sx.ay * sx.ay);
+            double bx_abs = sqrt(sx.bx * sx.bx + sx.by * sx.by);
+            double ry = (ax_abs > 0.0) ? max(0.0, (sqrt(sy.r2) - bx_abs * dc_max) / ax_abs) : 0.0;
+            double r = min(sqrt(sx.r2), ry);
+            step.r2 = r * r;
+        }
+        levels.push_back(move(level));
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef BLA_TABLE_HPP
+#define BLA_TABLE_HPP
+
+#include <vector>
+
+using namespace std;
+
+/**
+ * Reference orbit and bivariate linear approximation (BLA) table for the perturbation kernel.
+ *
+ * A pixel c = C + dc is iterated as a small deviation dz from the orbit Z of the reference C:
+ *      dz_{m+1} = 2 Z_m dz_m + dz_m^2 + dc
+ * As long as dz is small enough, the dz^2 term vanishes and l steps from reference iteration m collapse to
+ *      dz_{m+l} = A dz_m + B dc
+ * The table holds these (A, B) for blocks of 2^level steps, with the radius R within which |dz| has to be.
+ * Level 0 is a single step (A = 2 Z_m, B = 1, R = epsilon |Z_m|); a block of a level is merged from two of the level below.
+ * See https://mathr.co.uk/web/m-perturbation.html and Zhuoran's BLA on fractalforums.org.
+ */
+class BlaTable {
+    public:
+        BlaTable(double epsilon) : epsilon(epsilon) {};
+
+        struct Step {
+            double ax, ay;      // A
+            double bx, by;      // B
+            double r2;          // squared validity radius of |dz|
+            int length;         // nr of iterations skipped
+        };
+
+        /**
+         * Iterate the orbit of the reference (cx, cy) in quad precision up to max_its or until it escapes, and build the table.
+         * dc_max is the largest |dc| of the pixels that use it, i.e. the distance from the reference to the farthest corner.
+         */
+        void build(double cx, double cy, int max_its, double dc_max);
+
+        /**
+         * The longest valid approximation starting at reference iteration m for a |dz|^2 of dz2,
+         * skipping at most max_length iterations; nullptr if there is none and the pixel has to do a normal step.
+         */
+        inline const Step* lookup(int m, double dz2, int max_length) const {
+            if (m == 0) {
+                return nullptr;
+            }
+
+            // a block of a level starts at a multiple of its length; single steps (level 0) are not worth a lookup.
+            // A block is never valid for a larger dz than its first half, so go up until one is not valid
+            const Step* best = nullptr;
+            int nr_levels = static_cast<int>(levels.size());
+            for (int level = 1; level < nr_levels && (m & ((1 << level) - 1)) == 0; ++level) {
+                const Step& step = levels[level][m >> level];
+                if (dz2 >= step.r2 || step.length > max_length) {
+                    break;
+                }
+                best = &step;
+            }
+            return best;
+        };
+
+        // reference orbit, Z_0 = 0 up to the last iteration, which may be outside the bailout radius
+        vector<double> zx;
+        vector<double> zy;
+        double cx = 0.0;
+        double cy = 0.0;
+
+        int get_orbit_length() const { return static_cast<int>(zx.size()); };
+        int get_nr_levels() const { return static_cast<int>(levels.size()); };
+
+    private:
+        const double epsilon;
+
+        // levels[l][k] covers the steps from reference iteration k * 2^l, for k * 2^l < orbit length - 1
+        vector<vector<Step>> levels;
+};
+
+#endif
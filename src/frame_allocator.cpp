@@ -0,0 +1,136 @@
+#include "frame_allocator.hpp"
+
+#include <cstring>
+#include <new>
+
+#include "spdlog/spdlog.h"
+
+#if defined(__linux__)
+    #include <sys/mman.h>
+#endif
+
+static const size_t page_size = 4096;
+static const size_t huge_page_size = 2 * 1024 * 1024;
+
+
+FrameAllocator::FrameAllocator(Settings* settings, TaskScheduler* scheduler) :
+    huge_pages(parse_huge_pages(settings->huge_pages)),
+    numa_first_touch(settings->numa_first_touch),
+    scheduler(scheduler) {};
+
+
+FrameAllocator::~FrameAllocator() {
+    for (const Block& block : free_blocks) {
+        deallocate(block.data, block.bytes);
+    }
+}
+
+
+FrameAllocator::HugePages FrameAllocator::parse_huge_pages(const string& name) {
+    if (name == "none") {
+        return HugePages::none;
+    } else if (name == "explicit") {
+        return HugePages::explicit_pages;
+    } else if (name != "transparent") {
+        spdlog::warn("Unknown huge_pages setting '{}', using 'transparent'", name);
+    }
+    return HugePages::transparent;
+}
+
+
+/**
+ * Blocks are page aligned and a multiple of the (huge) page size,
+ * so the pages of one buffer are never shared with another buffer.
+ */
+size_t FrameAllocator::round_size(size_t bytes) const {
+    size_t granularity = (huge_pages == HugePages::none) ? page_size : huge_page_size;
+    return ((bytes + granularity - 1) / granularity) * granularity;
+}
+
+
+FrameAllocator::Buffer FrameAllocator::acquire(int rows, size_t row_bytes) {
+    size_t bytes = round_size(max(1, rows) * row_bytes);
+
+    // recycle a block of the same size, its pages are already mapped and placed
+    {
+        lock_guard<mutex> lock(free_mutex);
+        for (size_t b = 0; b < free_blocks.size(); ++b) {
+            if (free_blocks[b].bytes == bytes) {
+                Block block = free_blocks[b];
+                free_blocks.erase(free_blocks.begin() + b);
+                return Buffer(this, block.data, block.bytes);
+            }
+        }
+    }
+
+    void* data = allocate(bytes);
+    if (numa_first_touch) {
+        first_touch(data, rows, row_bytes);
+    }
+    return Buffer(this, data, bytes);
+}
+
+
+cv::Mat FrameAllocator::acquire_mat(int rows, int cols, int type, Buffer& buffer) {
+    size_t row_bytes = static_cast<size_t>(cols) * CV_ELEM_SIZE(type);
+    buffer = acquire(rows, row_bytes);
+    return cv::Mat(rows, cols, type, buffer.data(), row_bytes);
+}
+
+
+void FrameAllocator::release(void* data, size_t bytes) {
+    lock_guard<mutex> lock(free_mutex);
+    free_blocks.push_back({data, bytes});
+}
+
+
+void* FrameAllocator::allocate(size_t bytes) {
+#if defined(__linux__)
+    void* data = MAP_FAILED;
+
+    if (huge_pages == HugePages::explicit_pages) {
+        data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data == MAP_FAILED) {
+            spdlog::warn("No explicit huge pages available (see /proc/sys/vm/nr_hugepages), using transparent huge pages");
+        }
+    }
+
+    if (data == MAP_FAILED) {
+        data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            throw bad_alloc();
+        }
+        if (huge_pages != HugePages::none) {
+            // only a hint, the kernel may ignore it
+            madvise(data, bytes, MADV_HUGEPAGE);
+        }
+    }
+    return data;
+#else
+    return ::operator new(bytes, align_val_t(page_size));
+#endif
+}
+
+
+void FrameAllocator::deallocate(void* data, size_t bytes) {
+#if defined(__linux__)
+    munmap(data, bytes);
+#else
+    (void)bytes;
+    ::operator delete(data, align_val_t(page_size));
+#endif
+}
+
+
+/**
+ * Zero the buffer with the same row partition as the kernel, so the pages of a row block
+ * get allocated on the NUMA node of the worker that will write those rows.
+ * These units may not be stolen, or the pages would land on the node of the thief.
+ */
+void FrameAllocator::first_touch(void* data, int rows, size_t row_bytes) {
+    char* bytes = static_cast<char*>(data);
+
+    scheduler->parallel_for_home(0, rows, [&](int j_begin, int j_end) {
+        memset(bytes + j_begin * row_bytes, 0, (j_end - j_begin) * row_bytes);
+    });
+}
@@ -0,0 +1,92 @@
+#ifndef FRAME_ALLOCATOR_HPP
+#define FRAME_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "settings.hpp"
+#include "task_scheduler.hpp"
+
+using namespace std;
+
+/**
+ * Allocator for the large frame and iteration buffers (X, N, output_image, ...).
+ *
+ * - huge pages: "none", "transparent" (madvise, THP) or "explicit" (MAP_HUGETLB, falls back to transparent),
+ *   to reduce TLB misses on multi megabyte frames. Only on Linux, other platforms get plain aligned memory.
+ * - NUMA first touch: a new buffer is zeroed by the TaskScheduler, row block by row block,
+ *   using the same partition as the parallel loops over the rows. The OS then places each page on the node of
+ *   the worker that renders those rows. On a machine with more than one node this pins the workers (see TaskScheduler),
+ *   so they stay on their node.
+ * - recycling: released buffers go to a free list and are handed out again for the same size,
+ *   so pages stay mapped and placed across frames.
+ */
+class FrameAllocator {
+    public:
+        FrameAllocator(Settings* settings, TaskScheduler* scheduler);
+        ~FrameAllocator();
+
+        FrameAllocator(const FrameAllocator&) = delete;
+        FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+        // move-only handle of an allocated block; goes back to the free list of the allocator when destroyed
+        class Buffer {
+            public:
+                Buffer() {};
+                Buffer(FrameAllocator* owner, void* data, size_t bytes) : owner(owner), data_ptr(data), bytes(bytes) {};
+                Buffer(Buffer&& other) noexcept { swap(other); };
+                Buffer& operator=(Buffer&& other) noexcept { Buffer(std::move(other)).swap(*this); return *this; };
+                ~Buffer() { if (owner) owner->release(data_ptr, bytes); };
+
+                Buffer(const Buffer&) = delete;
+                Buffer& operator=(const Buffer&) = delete;
+
+                void* data() const { return data_ptr; };
+                size_t size() const { return bytes; };
+
+            private:
+                FrameAllocator* owner = nullptr;
+                void* data_ptr = nullptr;
+                size_t bytes = 0;
+
+                void swap(Buffer& other) noexcept {
+                    std::swap(owner, other.owner);
+                    std::swap(data_ptr, other.data_ptr);
+                    std::swap(bytes, other.bytes);
+                };
+        };
+
+        // get a buffer of rows * row_bytes, first touched per row block if it is new
+        Buffer acquire(int rows, size_t row_bytes);
+
+        // get a buffer and wrap it in a (non-owning) cv::Mat; buffer has to outlive the cv::Mat
+        cv::Mat acquire_mat(int rows, int cols, int type, Buffer& buffer);
+
+    private:
+        enum class HugePages { none, transparent, explicit_pages };
+
+        struct Block {
+            void* data;
+            size_t bytes;
+        };
+
+        const HugePages huge_pages;
+        const bool numa_first_touch;
+        TaskScheduler* scheduler;
+
+        mutex free_mutex;
+        vector<Block> free_blocks;
+
+        static HugePages parse_huge_pages(const string& name);
+        size_t round_size(size_t bytes) const;
+        void* allocate(size_t bytes);
+        void deallocate(void* data, size_t bytes);
+        void first_touch(void* data, int rows, size_t row_bytes);
+        void release(void* data, size_t bytes);
+};
+
+#endif
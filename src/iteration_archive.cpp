@@ -0,0 +1,356 @@
+#include "iteration_archive.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#if defined(_WIN32)
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace iteration_archive;
+
+static const char archive_magic[4] = {'M', 'B', 'F', 'A'};
+static const int32_t archive_version = 1;
+static const uint64_t frame_alignment = 64;
+
+
+/**
+ * Byte shuffle: first byte of every float, then the second byte, etc.
+ * The exponent and high mantissa bytes of neighbouring pixels are nearly the same, which deflates a lot better.
+ */
+static void shuffle_bytes(const unsigned char* in, unsigned char* out, size_t nr_floats) {
+    for (size_t b = 0; b < sizeof(float); ++b) {
+        for (size_t k = 0; k < nr_floats; ++k) {
+            out[b * nr_floats + k] = in[k * sizeof(float) + b];
+        }
+    }
+}
+
+static void unshuffle_bytes(const unsigned char* in, unsigned char* out, size_t nr_floats) {
+    for (size_t b = 0; b < sizeof(float); ++b) {
+        for (size_t k = 0; k < nr_floats; ++k) {
+            out[k * sizeof(float) + b] = in[b * nr_floats + k];
+        }
+    }
+}
+
+
+/**********************
+ * Writer
+ **********************/
+
+IterationArchiveWriter::IterationArchiveWriter(const string& filename, int nx, int ny, int chunk_rows, TaskScheduler* scheduler) :
+    filename(filename),
+    file(filename, ios::binary),
+    nx(nx),
+    ny(ny),
+    chunk_rows(max(1, chunk_rows)),
+    nr_chunks((ny + max(1, chunk_rows) - 1) / max(1, chunk_rows)),
+    scheduler(scheduler),
+    chunk_data(nr_chunks),
+    chunk_compressed(nr_chunks, 0) {
+
+    if (!file) {
+        cerr << "Could not open the iteration archive " << filename << endl;
+        failed = true;
+        return;
+    }
+
+    // the header is written again with the frame count and index offset on close
+    Header header = {};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    position = sizeof(header);
+}
+
+
+bool IterationArchiveWriter::write_frame(const cv::Mat& iterations, int max_its) {
+    if (!is_open()) {
+        return false;
+    }
+
+    // convert, shuffle and deflate every chunk in parallel
+    scheduler->parallel_for(0, nr_chunks, 1, [&](int c_begin, int c_end) {
+        vector<float> floats;
+        vector<unsigned char> shuffled;
+
+        for (int c = c_begin; c < c_end; ++c) {
+            int j_begin = c * chunk_rows;
+            int j_end = min(j_begin + chunk_rows, ny);
+            size_t nr_floats = static_cast<size_t>(j_end - j_begin) * nx;
+            size_t raw_bytes = nr_floats * sizeof(float);
+
+            floats.resize(nr_floats);
+            for (int j = j_begin; j < j_end; ++j) {
+                const double* n_row = iterations.ptr<double>(j);
+                float* float_row = floats.data() + static_cast<size_t>(j - j_begin) * nx;
+                for (int i = 0; i < nx; ++i) {
+                    float_row[i] = static_cast<float>(n_row[i]);
+                }
+            }
+
+            shuffled.resize(raw_bytes);
+            shuffle_bytes(reinterpret_cast<const unsigned char*>(floats.data()), shuffled.data(), nr_floats);
+
+            // level 1: the archive is written next to the render and should not slow it down
+            vector<unsigned char>& out = chunk_data[c];
+            uLongf compressed_bytes = compressBound(static_cast<uLong>(raw_bytes));
+            out.resize(compressed_bytes);
+            bool deflated = compress2(out.data(), &compressed_bytes, shuffled.data(), static_cast<uLong>(raw_bytes), 1) == Z_OK;
+
+            if (deflated && compressed_bytes < raw_bytes * 0.9) {
+                out.resize(compressed_bytes);
+                chunk_compressed[c] = 1;
+            } else {
+                out.assign(reinterpret_cast<const unsigned char*>(floats.data()), reinterpret_cast<const unsigned char*>(floats.data()) + raw_bytes);
+                chunk_compressed[c] = 0;
+            }
+        }
+    });
+
+    // align the frame, so a raw frame can be used in place as a float matrix
+    uint64_t padding = (frame_alignment - position % frame_alignment) % frame_alignment;
+    static const char zeros[frame_alignment] = {};
+    file.write(zeros, padding);
+    position += padding;
+
+    FrameEntry frame = {position, max_its, 1};
+    for (int c = 0; c < nr_chunks; ++c) {
+        chunks.push_back({position, static_cast<uint32_t>(chunk_data[c].size()), chunk_compressed[c] ? 1u : 0u});
+        frame.raw = frame.raw && !chunk_compressed[c];
+
+        file.write(reinterpret_cast<const char*>(chunk_data[c].data()), chunk_data[c].size());
+        position += chunk_data[c].size();
+    }
+
+    // e.g. a full disk: stop here, an archive with a hole in it is of no use
+    file.flush();
+    if (!file) {
+        cerr << "Could not write frame " << frames.size() << " to the iteration archive " << filename << endl;
+        failed = true;
+        file.close();
+        return false;
+    }
+    frames.push_back(frame);
+    return true;
+}
+
+
+bool IterationArchiveWriter::close() {
+    if (!is_open()) {
+        return !failed;
+    }
+
+    uint64_t index_offset = position;
+    file.write(reinterpret_cast<const char*>(frames.data()), frames.size() * sizeof(FrameEntry));
+    file.write(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(ChunkEntry));
+
+    Header header = {};
+    memcpy(header.magic, archive_magic, sizeof(archive_magic));
+    header.version = archive_version;
+    header.nx = nx;
+    header.ny = ny;
+    header.chunk_rows = chunk_rows;
+    header.nr_frames = static_cast<int32_t>(frames.size());
+    header.index_offset = index_offset;
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+
+    if (!file) {
+        cerr << "Could not write the index of the iteration archive " << filename << endl;
+        failed = true;
+    }
+    return !failed;
+}
+
+
+/**********************
+ * Reader
+ **********************/
+
+IterationArchiveReader::IterationArchiveReader(const string& filename) : header() {
+    if (!map_file(filename)) {
+        cerr << "Could not map the iteration archive " << filename << endl;
+        return;
+    }
+
+    if (mapping_size < sizeof(Header)) {
+        cerr << filename << " is not an iteration archive" << endl;
+        unmap_file();
+        return;
+    }
+    memcpy(&header, mapping, sizeof(Header));
+
+    // an archive without index was not closed, e.g. the render was interrupted
+    if (memcmp(header.magic, archive_magic, sizeof(archive_magic)) != 0 || header.version != archive_version) {
+        cerr << filename << " is not a (finished) iteration archive" << endl;
+        unmap_file();
+        return;
+    }
+
+    if (header.nx <= 0 || header.ny <= 0 || header.chunk_rows <= 0 || header.nr_frames <= 0) {
+        cerr << filename << " has an invalid header" << endl;
+        unmap_file();
+        return;
+    }
+
+    // sizes in 64 bit and compared without adding to the offsets, a corrupt header must not wrap around
+    nr_chunks = (header.ny + header.chunk_rows - 1) / header.chunk_rows;
+    uint64_t index_bytes = static_cast<uint64_t>(header.nr_frames) * (sizeof(FrameEntry) + static_cast<uint64_t>(nr_chunks) * sizeof(ChunkEntry));
+    if (header.index_offset > mapping_size || index_bytes > mapping_size - header.index_offset) {
+        cerr << filename << " is truncated" << endl;
+        unmap_file();
+        return;
+    }
+
+    const FrameEntry* frame_index = reinterpret_cast<const FrameEntry*>(mapping + header.index_offset);
+    const ChunkEntry* chunk_index = reinterpret_cast<const ChunkEntry*>(frame_index + header.nr_frames);
+    frames.assign(frame_index, frame_index + header.nr_frames);
+    chunks.assign(chunk_index, chunk_index + static_cast<size_t>(header.nr_frames) * nr_chunks);
+
+    // every frame and chunk has to be inside the mapping, and a raw chunk exactly its rows, so read_frame can trust the index
+    uint64_t frame_bytes = static_cast<uint64_t>(header.nx) * header.ny * sizeof(float);
+    bool valid = true;
+    for (size_t f = 0; f < frames.size() && valid; ++f) {
+        valid = !frames[f].raw || (frames[f].offset <= mapping_size && frame_bytes <= mapping_size - frames[f].offset);
+
+        for (int c = 0; c < nr_chunks && valid; ++c) {
+            const ChunkEntry& chunk = chunks[f * nr_chunks + c];
+            uint64_t chunk_bytes = static_cast<uint64_t>(min(header.chunk_rows, header.ny - c * header.chunk_rows)) * header.nx * sizeof(float);
+            valid = chunk.offset <= mapping_size && chunk.stored_bytes <= mapping_size - chunk.offset
+                && (chunk.compressed || chunk.stored_bytes == chunk_bytes);
+        }
+    }
+    if (!valid) {
+        cerr << filename << " has an index entry outside of the file" << endl;
+        frames.clear();
+        chunks.clear();
+        unmap_file();
+        return;
+    }
+}
+
+
+IterationArchiveReader::~IterationArchiveReader() {
+    unmap_file();
+}
+
+
+cv::Mat IterationArchiveReader::read_frame(int frame_nr, cv::Mat& buffer, TaskScheduler* scheduler) const {
+    if (frame_nr < 0 || frame_nr >= static_cast<int>(frames.size())) {
+        throw out_of_range("Frame " + to_string(frame_nr) + " is not in the iteration archive");
+    }
+    const FrameEntry& frame = frames[frame_nr];
+
+    // zero-copy: the frame is one contiguous float matrix in the mapping
+    if (frame.raw) {
+        return cv::Mat(header.ny, header.nx, CV_32FC1, const_cast<unsigned char*>(mapping + frame.offset));
+    }
+
+    scheduler->parallel_for(0, nr_chunks, 1, [&](int c_begin, int c_end) {
+        vector<unsigned char> shuffled;
+
+        for (int c = c_begin; c < c_end; ++c) {
+            const ChunkEntry& chunk = chunks[static_cast<size_t>(frame_nr) * nr_chunks + c];
+            int j_begin = c * header.chunk_rows;
+            int j_end = min(j_begin + header.chunk_rows, header.ny);
+            size_t nr_floats = static_cast<size_t>(j_end - j_begin) * header.nx;
+            unsigned char* out = buffer.ptr<unsigned char>(j_begin);
+
+            if (!chunk.compressed) {
+                memcpy(out, mapping + chunk.offset, chunk.stored_bytes);
+                continue;
+            }
+
+            // inflate straight from the mapping
+            shuffled.resize(nr_floats * sizeof(float));
+            uLongf raw_bytes = static_cast<uLongf>(shuffled.size());
+            if (uncompress(shuffled.data(), &raw_bytes, mapping + chunk.offset, chunk.stored_bytes) != Z_OK || raw_bytes != shuffled.size()) {
+                throw runtime_error("Corrupt chunk in the iteration archive");
+            }
+            unshuffle_bytes(shuffled.data(), out, nr_floats);
+        }
+    });
+
+    return buffer;
+}
+
+
+bool IterationArchiveReader::map_file(const string& filename) {
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+
+    HANDLE file_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = file_mapping ? MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (file_mapping) {
+            CloseHandle(file_mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle = file;
+    mapping_handle = file_mapping;
+    mapping = static_cast<const unsigned char*>(view);
+    mapping_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // the mapping keeps the file
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    // frames are read front to back
+    madvise(view, file_stat.st_size, MADV_SEQUENTIAL);
+
+    mapping = static_cast<const unsigned char*>(view);
+    mapping_size = file_stat.st_size;
+#endif
+    return true;
+}
+
+
+void IterationArchiveReader::unmap_file() {
+    if (!mapping) {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(mapping);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+#else
+    munmap(const_cast<unsigned char*>(mapping), mapping_size);
+#endif
+
+    mapping = nullptr;
+    mapping_size = 0;
+}
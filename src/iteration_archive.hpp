@@ -0,0 +1,124 @@
+#ifndef ITERATION_ARCHIVE_HPP
+#define ITERATION_ARCHIVE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "task_scheduler.hpp"
+
+using namespace std;
+
+/**
+ * Archive of the smooth iteration field (N) of every frame of a video, to recolor it later without iterating again.
+ *
+ * Layout of the file:
+ *  - a 64 byte header: magic, version, nx, ny, chunk_rows, nr_frames and the offset of the index
+ *  - per frame, 64 byte aligned: the chunks of chunk_rows rows, as 32 bit floats.
+ *    A chunk is byte shuffled and deflated (zlib) if that saves at least 10%, and stored raw otherwise.
+ *  - the index: a FrameEntry per frame, followed by a ChunkEntry per chunk of every frame
+ * The reader memory maps the file; a frame that is stored raw is used in place, without any copy.
+ */
+namespace iteration_archive {
+    struct Header {
+        char magic[4];
+        int32_t version;
+        int32_t nx;
+        int32_t ny;
+        int32_t chunk_rows;
+        int32_t nr_frames;
+        uint64_t index_offset;
+        char reserved[32];
+    };
+
+    struct FrameEntry {
+        uint64_t offset;
+        int32_t max_its;
+        int32_t raw;        // all chunks raw, so the frame is one contiguous float matrix
+    };
+
+    struct ChunkEntry {
+        uint64_t offset;
+        uint32_t stored_bytes;
+        uint32_t compressed;
+    };
+}
+
+
+class IterationArchiveWriter {
+    public:
+        IterationArchiveWriter(const string& filename, int nx, int ny, int chunk_rows, TaskScheduler* scheduler);
+        ~IterationArchiveWriter() { close(); };
+
+        bool is_open() const { return file.is_open(); };
+
+        // append a CV_64FC1 iteration field (negative inside the set); chunks are compressed in parallel.
+        // Returns false if the frame could not be written; the archive is closed then, and skips the following frames
+        bool write_frame(const cv::Mat& iterations, int max_its);
+
+        // write the index; called by the destructor if not done before. Returns false if the archive is incomplete
+        bool close();
+
+    private:
+        const string filename;
+        ofstream file;
+        bool failed = false;
+        const int nx;
+        const int ny;
+        const int chunk_rows;
+        const int nr_chunks;
+        TaskScheduler* scheduler;
+
+        uint64_t position = 0;
+        vector<iteration_archive::FrameEntry> frames;
+        vector<iteration_archive::ChunkEntry> chunks;
+
+        // per chunk output of the current frame, reused for every frame
+        vector<vector<unsigned char>> chunk_data;
+        vector<uint8_t> chunk_compressed;   // not vector<bool>, chunks are written in parallel
+};
+
+
+class IterationArchiveReader {
+    public:
+        IterationArchiveReader(const string& filename);
+        ~IterationArchiveReader();
+
+        IterationArchiveReader(const IterationArchiveReader&) = delete;
+        IterationArchiveReader& operator=(const IterationArchiveReader&) = delete;
+
+        bool is_open() const { return mapping != nullptr; };
+        int get_nx() const { return header.nx; };
+        int get_ny() const { return header.ny; };
+        int get_nr_frames() const { return header.nr_frames; };
+        int get_max_its(int frame_nr) const { return frames.at(frame_nr).max_its; };
+
+        /**
+         * The iteration field of a frame as a CV_32FC1 matrix.
+         * A raw frame is a matrix directly on the mapped file (valid as long as the reader is);
+         * otherwise the chunks are inflated in parallel into buffer, which should be a ny x nx CV_32FC1 matrix.
+         * Throws out_of_range for a frame_nr outside of [0, get_nr_frames()).
+         */
+        cv::Mat read_frame(int frame_nr, cv::Mat& buffer, TaskScheduler* scheduler) const;
+
+    private:
+        iteration_archive::Header header;
+        vector<iteration_archive::FrameEntry> frames;
+        vector<iteration_archive::ChunkEntry> chunks;
+        int nr_chunks = 0;
+
+        const unsigned char* mapping = nullptr;
+        size_t mapping_size = 0;
+#if defined(_WIN32)
+        void* file_handle = nullptr;
+        void* mapping_handle = nullptr;
+#endif
+
+        bool map_file(const string& filename);
+        void unmap_file();
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "iteration_state.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// file layout: magic, version, nx, ny, max_its, view corners, number of slots, the values and then the slots
+static const char state_magic[4] = {'M', 'B', 'S', 'T'};
+static const int32_t state_version = 2;
+
+
+bool IterationState::matches(const vector<double>& x_cor, const vector<double>& y_cor) const {
+    return static_cast<int>(x_cor.size()) == nx && static_cast<int>(y_cor.size()) == ny &&
+           !value.empty() &&
+           x_cor.front() == x_first && x_cor.back() == x_last &&
+           y_cor.front() == y_first && y_cor.back() == y_last;
+}
+
+
+void IterationState::reset(const vector<double>& x_cor, const vector<double>& y_cor) {
+    size_t nr_pixels = static_cast<size_t>(nx) * ny;
+
+    x_first = x_cor.front();
+    x_last = x_cor.back();
+    y_first = y_cor.front();
+    y_last = y_cor.back();
+    max_its = 0;
+
+    value.assign(nr_pixels, -1.0f);
+    zx.assign(nr_pixels, 0.0);
+    zy.assign(nr_pixels, 0.0);
+    n.assign(nr_pixels, 0);
+}
+
+
+long long IterationState::count_unescaped(int max_its) const {
+    long long count = 0;
+    for (int32_t slot_n : n) {
+        count += (slot_n < max_its) ? 1 : 0;
+    }
+    return count;
+}
+
+
+void IterationState::index_rows() {
+    row_first_slot.assign(ny + 1, 0);
+    for (int j = 0; j < ny; ++j) {
+        const float* row = value.data() + static_cast<size_t>(j) * nx;
+        size_t nr_slots = 0;
+        for (int i = 0; i < nx; ++i) {
+            nr_slots += (row[i] < 0.0f) ? 1 : 0;
+        }
+        row_first_slot[j + 1] = row_first_slot[j] + nr_slots;
+    }
+}
+
+
+void IterationState::compact() {
+    size_t kept = 0;
+    for (size_t slot = 0; slot < n.size(); ++slot) {
+        if (n[slot] < 0) {
+            continue;
+        }
+        zx[kept] = zx[slot];
+        zy[kept] = zy[slot];
+        n[kept] = n[slot];
+        kept++;
+    }
+    zx.resize(kept);
+    zy.resize(kept);
+    n.resize(kept);
+}
+
+
+/**
+ * The state is written next to filename and then renamed over it, so a crash halfway leaves the previous state intact.
+ */
+bool IterationState::save(const string& filename) const {
+    string temporary_filename = filename + ".tmp";
+    {
+        ofstream file(temporary_filename, ios::binary);
+        if (!file) {
+            cerr << "Could not write iteration state to " << temporary_filename << endl;
+            return false;
+        }
+
+        int32_t header[4] = {state_version, nx, ny, max_its};
+        double view[4] = {x_first, x_last, y_first, y_last};
+        uint64_t nr_slots = n.size();
+
+        file.write(state_magic, sizeof(state_magic));
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(view), sizeof(view));
+        file.write(reinterpret_cast<const char*>(&nr_slots), sizeof(nr_slots));
+        file.write(reinterpret_cast<const char*>(value.data()), value.size() * sizeof(float));
+        file.write(reinterpret_cast<const char*>(zx.data()), zx.size() * sizeof(double));
+        file.write(reinterpret_cast<const char*>(zy.data()), zy.size() * sizeof(double));
+        file.write(reinterpret_cast<const char*>(n.data()), n.size() * sizeof(int32_t));
+
+        file.close();
+        if (!file) {
+            cerr << "Could not write iteration state to " << temporary_filename << endl;
+            remove(temporary_filename.c_str());
+            return false;
+        }
+    }
+
+    // rename does not replace an existing file on Windows
+#if defined(_WIN32)
+    remove(filename.c_str());
+#endif
+    if (rename(temporary_filename.c_str(), filename.c_str()) != 0) {
+        cerr << "Could not replace " << filename << " by " << temporary_filename << endl;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Returns false, leaving the state untouched, if the file does not exist or was written for another resolution.
+ * Whether it is the same view is up to the caller, see matches().
+ */
+bool IterationState::load(const string& filename) {
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    char magic[4];
+    int32_t header[4];
+    double view[4];
+    uint64_t nr_slots = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    file.read(reinterpret_cast<char*>(view), sizeof(view));
+    file.read(reinterpret_cast<char*>(&nr_slots), sizeof(nr_slots));
+
+    if (!file || memcmp(magic, state_magic, sizeof(magic)) != 0 || header[0] != state_version) {
+        cerr << filename << " is not an iteration state file" << endl;
+        return false;
+    }
+    size_t nr_pixels = static_cast<size_t>(nx) * ny;
+    if (header[1] != nx || header[2] != ny || nr_slots > nr_pixels) {
+        cerr << filename << " holds the iteration state of another resolution" << endl;
+        return false;
+    }
+
+    vector<float> file_value(nr_pixels);
+    vector<double> file_zx(nr_slots), file_zy(nr_slots);
+    vector<int32_t> file_n(nr_slots);
+
+    file.read(reinterpret_cast<char*>(file_value.data()), nr_pixels * sizeof(float));
+    file.read(reinterpret_cast<char*>(file_zx.data()), nr_slots * sizeof(double));
+    file.read(reinterpret_cast<char*>(file_zy.data()), nr_slots * sizeof(double));
+    file.read(reinterpret_cast<char*>(file_n.data()), nr_slots * sizeof(int32_t));
+
+    if (!file) {
+        cerr << filename << " is truncated" << endl;
+        return false;
+    }
+
+    // every pixel that is still iterated has exactly one slot
+    size_t nr_unescaped = 0;
+    for (float v : file_value) {
+        nr_unescaped += (v < 0.0f) ? 1 : 0;
+    }
+    if (nr_unescaped != nr_slots) {
+        cerr << filename << " is corrupt" << endl;
+        return false;
+    }
+
+    max_its = header[3];
+    x_first = view[0];
+    x_last = view[1];
+    y_first = view[2];
+    y_last = view[3];
+    value = move(file_value);
+    zx = move(file_zx);
+    zy = move(file_zy);
+    n = move(file_n);
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef ITERATION_STATE_HPP
+#define ITERATION_STATE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * State of the escape time iteration for one view,
+ * so a render with a higher max_its can continue where the previous one stopped instead of starting over.
+ *
+ * Compact: an escaped pixel only needs its smooth iteration count, a float per pixel (-1 for a pixel that is still iterated).
+ * Only the pixels that are still iterated keep z and n, in slots in row-major order of their pixels:
+ * 4 bytes per pixel and 20 more per unescaped pixel, instead of 21 bytes for every pixel.
+ * A pixel that escaped on exactly the last iteration keeps its slot: whether it is in the set depends on the max_its of the render.
+ */
+class IterationState {
+    public:
+        IterationState(int nx, int ny) : nx(nx), ny(ny) {};
+
+        // is this the state of the view spanned by x_cor and y_cor?
+        bool matches(const vector<double>& x_cor, const vector<double>& y_cor) const;
+
+        // start over for a new view: all pixels at z = 0, n = 0
+        void reset(const vector<double>& x_cor, const vector<double>& y_cor);
+
+        // binary file, so later sessions can continue to refine the same view; written to a temporary file which replaces it
+        bool save(const string& filename) const;
+        bool load(const string& filename);
+
+        // number of pixels that did not escape within max_its, i.e. the pixels a follow-up render still has to do
+        long long count_unescaped(int max_its) const;
+
+        // first slot of every row (and the number of slots at ny), before a kernel walks the rows in parallel
+        void index_rows();
+
+        // drop the slots of the pixels that escaped (n set to -1 by the kernel)
+        void compact();
+
+        const int nx;
+        const int ny;
+
+        // highest max_its this state has been iterated to
+        int max_its = 0;
+
+        // per pixel
+        vector<float> value;
+
+        // per unescaped pixel
+        vector<double> zx;
+        vector<double> zy;
+        vector<int32_t> n;
+
+        // from index_rows
+        vector<size_t> row_first_slot;
+
+    private:
+        // corners of the view, to recognise it again
+        double x_first = 0.0, x_last = 0.0;
+        double y_first = 0.0, y_last = 0.0;
+};
+
+#endif
@@ -1,5 +1,20 @@
 #include "mandelbrot.hpp"
+
+#include <algorithm>
+#include <cstring>
     
+static const double bailout = 4.0;
+static const double log2_inv = 1.0 / log(2.0); // Precompute / log(2)
+
+/**
+ * Smooth (fractional) iteration count of an escaped point, from the iteration count n and |z_n|^2
+ */
+static inline double smooth_iterations(int n, double modulus2) {
+    double log_zn = log(modulus2) / 2; // in ln |z| because |z| of a complex number is just sqrt(x^2 + y^2) without its cross components
+    double nu = log(log_zn) * log2_inv;
+    return n + 1 - nu;
+}
+
 
 /**
  * Escape time algorithm; optimised variant.
@@ -8,43 +23,393 @@
  * Here x_corr are the real values, y_corr the imaginary in terms of the mandelbrot fractal
  */
 void Mandelbrot::mandelbrot(const std::vector<double> &x_cor, const std::vector<double> &y_cor, const int max_its) {
-    const double bailout = 4.0;
-    const double log2_inv = 1.0 / log(2.0); // Precompute / log(2)
-
-    // Parallelize the outer loops with OpenMP
-    #pragma omp parallel for
-    for (int idx = 0; idx < nx * ny; ++idx) {
-        // Because the MSVC compiler does not support OpenMP 3 and collapse(2) yet we rewrite to manual indexing. Slightly faster.
-        //  for (int i = 0; i < nx; i++) {
-        //      for (int j = 0; j < ny; j++) {
-
-        int i = idx / ny;  // Flattened index for i
-        int j = idx % ny;  // Flattened index for j
-
-        double x = 0.0, y = 0.0;
-        double x2 = 0.0, y2 = 0.0;
-        int n = 0;
-
-        while (x2 + y2 <= bailout && n < max_its) {
-            y = 2.0 * x * y + y_cor[j];
-            x = x2 - y2 + x_cor[i];
-            x2 = x * x;
-            y2 = y * y;
-            n++;
+    mandelbrot(x_cor, y_cor, max_its, vector<TaskScheduler::WorkUnit>());
+}
+
+
+/**
+ * Escape time algorithm with the rows split in the given work units (see RenderPlanner::make_work_units),
+ * or one unit per row if there are none.
+ */
+void Mandelbrot::mandelbrot(const std::vector<double> &x_cor, const std::vector<double> &y_cor, const int max_its, const vector<TaskScheduler::WorkUnit> &units) {
+    // rows that are mirror images of other rows are not iterated, but copied after the kernel
+    nr_mirrored_rows = plan_mirrored_rows(y_cor);
+
+    // Parallelize over the rows with the work-stealing scheduler:
+    // rows near the set are far more expensive than those outside of it, small units let idle workers steal them.
+    auto kernel = [&](int j_begin, int j_end) {
+        for (int j = j_begin; j < j_end; ++j) {
+            if (cancel_requested.load(memory_order_relaxed)) {
+                return;
+            }
+            if (mirror_source[j] >= 0) {
+                row_iterations[j] = 0;
+                continue;
+            }
+
+            // row-major order, so the inner loop walks along a row of N
+            double* n_row = N.ptr<double>(j);
+            long long its = 0;
+
+            for (int i = 0; i < nx; ++i) {
+                double x = 0.0, y = 0.0;
+                double x2 = 0.0, y2 = 0.0;
+                int n = 0;
+
+                while (x2 + y2 <= bailout && n < max_its) {
+                    y = 2.0 * x * y + y_cor[j];
+                    x = x2 - y2 + x_cor[i];
+                    x2 = x * x;
+                    y2 = y * y;
+                    n++;
+                }
+
+                // Negative for those pixels in the set, colored black
+                n_row[i] = (n < max_its) ? smooth_iterations(n, x2 + y2) : -1.0;
+                its += n;
+            }
+            row_iterations[j] = its;
         }
+    };
+
+    if (units.empty()) {
+        scheduler.parallel_for(0, ny, 1, kernel);
+    } else {
+        scheduler.run_units(units, 0, ny, kernel);
+    }
+
+    if (cancel_requested.load()) {
+        return;
+    }
+    if (nr_mirrored_rows > 0) {
+        fill_mirrored_rows();
+    }
+    applyContinuousColormap(N, X);
+}
+
+
+/**
+ * The row k of which row j is the exact mirror image (y_cor[k] == -y_cor[j]), for a row j on the smaller side of the real axis;
+ * -1 if there is none. y_cor goes from + to - with a constant step and straddles the axis.
+ */
+int Mandelbrot::exact_mirror_row(const std::vector<double> &y_cor, int j) const {
+    int nr_rows = static_cast<int>(y_cor.size());
+    bool mirror_lower = -y_cor.back() <= y_cor.front();
+    if ((mirror_lower && y_cor[j] >= 0.0) || (!mirror_lower && y_cor[j] <= 0.0)) {
+        return -1;
+    }
+
+    double step = (y_cor.back() - y_cor.front()) / (nr_rows - 1);
+    int k = static_cast<int>(lround((-y_cor[j] - y_cor.front()) / step));
+    return (k >= 0 && k < nr_rows && y_cor[k] == -y_cor[j]) ? k : -1;
+}
+
+
+/**
+ * For symmetry_resample: the row k0 such that the mirror image of row j lies between the computed rows k0 and k0 + 1,
+ * with weight the fraction of the way to k0 + 1; -1 if there are no such computed rows. Same conditions on y_cor and j as above.
+ */
+int Mandelbrot::resampled_mirror_row(const std::vector<double> &y_cor, int j, double &weight) const {
+    int nr_rows = static_cast<int>(y_cor.size());
+    bool mirror_lower = -y_cor.back() <= y_cor.front();
+    if ((mirror_lower && y_cor[j] >= 0.0) || (!mirror_lower && y_cor[j] <= 0.0)) {
+        return -1;
+    }
+
+    double step = (y_cor.back() - y_cor.front()) / (nr_rows - 1);
+    double mirrored_y = -y_cor[j];
+    double position = (mirrored_y - y_cor.front()) / step;
+
+    // both rows around the mirror image have to be computed rows
+    int k0 = static_cast<int>(floor(position));
+    bool computed = k0 >= 0 && k0 + 1 < nr_rows && (mirror_lower ? y_cor[k0 + 1] >= 0.0 : y_cor[k0] <= 0.0);
+    if (!computed || y_cor[k0] < mirrored_y || mirrored_y < y_cor[k0 + 1]) {
+        return -1;
+    }
+    weight = (y_cor[k0] - mirrored_y) / (y_cor[k0] - y_cor[k0 + 1]);
+    return k0;
+}
 
-        if (n < max_its) {
-            double log_zn = log(x2 + y2) / 2; // in ln |z| because |z| of a complex number is just sqrt(x^2 + y^2) without its cross components
-            double nu = log(log_zn) * log2_inv;
-            double n_frac = n + 1 - nu;
 
-            // Take the modulus for cyclic coloring
-            X.at<cv::Vec3d>(j, i) = applyContinuousColormap(fmod(n_frac, 255.0));
-        } else {
-            // Set to black for those pixels in the set
-            X.at<cv::Vec3d>(j, i) = {0.0, 0.0, 0.0};
+/**
+ * Conjugate symmetry: the orbit of conj(c) is the conjugate of the orbit of c, so the rows of a view that straddles
+ * the real axis are mirror images of each other. Negating y is exact in floating point, so a row with y_cor[j] == -y_cor[k]
+ * gets exactly the iterations of row k. The rows of the smaller side are mirrored from the larger side.
+ *
+ * Only the rows of which the mirror image is exactly another row are mirrored. With a plain linspace that depends on its
+ * rounding, about half of them for a view centered on the axis and none if the view is offset by a fraction of a row;
+ * with symmetry_snap (see y_linspace) it is all rows of the smaller side.
+ * With symmetry_resample, the other rows of the smaller side are interpolated between the two rows around their mirror image.
+ * Returns the number of mirrored rows.
+ */
+int Mandelbrot::plan_mirrored_rows(const std::vector<double> &y_cor) {
+    fill(mirror_source.begin(), mirror_source.end(), -1);
+
+    int nr_rows = static_cast<int>(y_cor.size());
+    if (!conjugate_symmetry || nr_rows < 2 || y_cor.front() <= 0.0 || y_cor.back() >= 0.0) {
+        return 0;
+    }
+
+    // y_cor goes from + to -, with a constant (negative) step
+    int nr_mirrored = 0;
+    for (int j = 0; j < nr_rows; ++j) {
+        int k = exact_mirror_row(y_cor, j);
+        if (k >= 0) {
+            mirror_source[j] = k;
+            mirror_weight[j] = 0.0;
+            nr_mirrored++;
+            continue;
+        }
+
+        double weight = 0.0;
+        k = symmetry_resample ? resampled_mirror_row(y_cor, j, weight) : -1;
+        if (k >= 0) {
+            mirror_source[j] = k;
+            mirror_weight[j] = weight;
+            nr_mirrored++;
         }
     }
+    return nr_mirrored;
+}
+
+
+void Mandelbrot::fill_mirrored_rows() {
+    scheduler.parallel_for(0, ny, 16, [&](int j_begin, int j_end) {
+        for (int j = j_begin; j < j_end; ++j) {
+            int k = mirror_source[j];
+            if (k < 0) {
+                continue;
+            }
+
+            double* n_row = N.ptr<double>(j);
+            const double* source_row = N.ptr<double>(k);
+            double t = mirror_weight[j];
+            if (t == 0.0) {
+                memcpy(n_row, source_row, nx * sizeof(double));
+                continue;
+            }
+
+            // resampled: interpolate escaped pixels, take the nearest row at the edge of the set
+            const double* next_row = N.ptr<double>(k + 1);
+            for (int i = 0; i < nx; ++i) {
+                double a = source_row[i];
+                double b = next_row[i];
+                n_row[i] = (a >= 0.0 && b >= 0.0) ? (1.0 - t) * a + t * b : ((t < 0.5) ? a : b);
+            }
+        }
+    });
+}
+
+
+/**
+ * Perturbation variant of the escape time algorithm, with bivariate linear approximation (see BlaTable).
+ *
+ * Every pixel iterates its deviation dz from the reference orbit of the center of the view,
+ * and jumps as many iterations as the table allows at once; only when dz is too large for any approximation
+ * it does a normal perturbation step. When z gets closer to 0 than dz, or the reference orbit ends,
+ * the pixel is rebased onto the start of the orbit (dz = z), so any reference works, even one that escapes.
+ *
+ * The view is given by its center and size rather than by pixel coordinates: dc is the exact offset of a pixel
+ * from the center, a multiple of the pixel size, not the difference of two rounded coordinates, which would quantize dc
+ * to the spacing of doubles around the center. With the reference orbit in quad precision (see BlaTable::build),
+ * still views go below the height of about 1e-13 where the escape time algorithm breaks down. The center itself
+ * is a double, so in a video consecutive frame centers jump below a height of about 1e-14.
+ * The BLA jumps only save iterations once dz is small, for heights below about 1e-12.
+ * row_iterations counts steps and jumps, the cost of a row.
+ */
+void Mandelbrot::mandelbrot_bla(double x, double y, double height, const int max_its, const vector<TaskScheduler::WorkUnit> &units) {
+    double width = height * (static_cast<double>(nx) / ny);
+    double step_x = (nx > 1) ? width / (nx - 1) : 0.0;
+    double step_y = (ny > 1) ? height / (ny - 1) : 0.0;
+    double dc_max = hypot(width / 2.0, height / 2.0);
+    bla_table.build(x, y, max_its, dc_max);
+
+    const double* zx = bla_table.zx.data();
+    const double* zy = bla_table.zy.data();
+    const int last_m = bla_table.get_orbit_length() - 1;
+
+    auto kernel = [&](int j_begin, int j_end) {
+        for (int j = j_begin; j < j_end; ++j) {
+            if (cancel_requested.load(memory_order_relaxed)) {
+                return;
+            }
+
+            double* n_row = N.ptr<double>(j);
+            double dcy = ((ny - 1) / 2.0 - j) * step_y;   // y runs from + to -
+            long long its = 0;
+
+            for (int i = 0; i < nx; ++i) {
+                double dcx = (i - (nx - 1) / 2.0) * step_x;
+                double dzx = 0.0, dzy = 0.0;
+                double modulus2 = 0.0;
+                int m = 0;
+                int n = 0;
+
+                while (n < max_its) {
+                    double z_x = 0.0, z_y = 0.0;
+
+                    // follow the reference orbit until the pixel escapes or has to be rebased;
+                    // the rebase is a loop exit rather than a branch in the loop, which keeps it out of the dependency chain of dz
+                    while (true) {
+                        const BlaTable::Step* step = bla_table.lookup(m, dzx * dzx + dzy * dzy, max_its - n);
+
+                        if (step) {
+                            // dz = A dz + B dc
+                            double dzx_new = step->ax * dzx - step->ay * dzy + step->bx * dcx - step->by * dcy;
+                            dzy = step->ax * dzy + step->ay * dzx + step->bx * dcy + step->by * dcx;
+                            dzx = dzx_new;
+                            m += step->length;
+                            n += step->length;
+                        } else {
+                            // dz = (2 Z + dz) dz + dc
+                            double tx = 2.0 * zx[m] + dzx;
+                            double ty = 2.0 * zy[m] + dzy;
+                            double dzx_new = tx * dzx - ty * dzy + dcx;
+                            dzy = tx * dzy + ty * dzx + dcy;
+                            dzx = dzx_new;
+                            m++;
+                            n++;
+                        }
+                        its++;
+
+                        z_x = zx[m] + dzx;
+                        z_y = zy[m] + dzy;
+                        modulus2 = z_x * z_x + z_y * z_y;
+                        if (modulus2 > bailout || n >= max_its || m == last_m || modulus2 < dzx * dzx + dzy * dzy) {
+                            break;
+                        }
+                    }
+
+                    if (modulus2 > bailout) {
+                        break;
+                    }
+
+                    // rebase: z is closer to 0 than dz, or the reference orbit ends
+                    dzx = z_x;
+                    dzy = z_y;
+                    m = 0;
+                }
+
+                n_row[i] = (n < max_its) ? smooth_iterations(n, modulus2) : -1.0;
+            }
+            row_iterations[j] = its;
+        }
+    };
+
+    if (units.empty()) {
+        scheduler.parallel_for(0, ny, 1, kernel);
+    } else {
+        scheduler.run_units(units, 0, ny, kernel);
+    }
+
+    if (cancel_requested.load()) {
+        return;
+    }
+    applyContinuousColormap(N, X);
+}
+
+
+/**
+ * Resumable variant of the escape time algorithm.
+ * 
+ * Continues every pixel that had not escaped from the (z, n) in its slot of state, and writes the new (z, n) back.
+ * Pixels that escaped before are not iterated again but take their stored value, so going from max_its = 2000 to 20000 
+ * only costs the extra iterations of the pixels that had not escaped yet.
+ * The result is that of an uninterrupted render with the same max_its, up to the float precision of the stored values.
+ */
+void Mandelbrot::mandelbrot(const std::vector<double> &x_cor, const std::vector<double> &y_cor, const int max_its, IterationState &state) {
+    // the slots of the pixels that are still iterated, in row-major order, so rows can be done in parallel
+    state.index_rows();
+
+    scheduler.parallel_for(0, ny, 1, [&](int j_begin, int j_end) {
+        for (int j = j_begin; j < j_end; ++j) {
+            double* n_row = N.ptr<double>(j);
+            const float* value_row = state.value.data() + static_cast<size_t>(j) * nx;
+            size_t slot = state.row_first_slot[j];
+
+            long long its = 0;
+
+            for (int i = 0; i < nx; ++i) {
+                // escaped in an earlier render
+                if (value_row[i] >= 0.0f) {
+                    n_row[i] = value_row[i];
+                    continue;
+                }
+
+                double x = state.zx[slot], y = state.zy[slot];
+                double x2 = x * x, y2 = y * y;
+                int n = state.n[slot];
+
+                while (x2 + y2 <= bailout && n < max_its) {
+                    y = 2.0 * x * y + y_cor[j];
+                    x = x2 - y2 + x_cor[i];
+                    x2 = x * x;
+                    y2 = y * y;
+                    n++;
+                }
+                its += n - state.n[slot];
+
+                if (x2 + y2 > bailout && n < max_its) {
+                    // escaped for good: only the smooth iteration count is kept, the slot is dropped by compact()
+                    n_row[i] = smooth_iterations(n, x2 + y2);
+                    state.value[static_cast<size_t>(j) * nx + i] = static_cast<float>(n_row[i]);
+                    state.n[slot] = -1;
+                } else {
+                    // in the set at this max_its, also when it escaped on the last iteration, which a deeper render would show
+                    n_row[i] = -1.0;
+                    state.zx[slot] = x;
+                    state.zy[slot] = y;
+                    state.n[slot] = n;
+                }
+                slot++;
+            }
+            row_iterations[j] = its;
+        }
+    });
+
+    state.compact();
+    state.max_its = max(state.max_its, max_its);
+
+    applyContinuousColormap(N, X);
+}
+
+
+/**
+ * Iterations only, per row, for a view of any resolution. 
+ * Same loop as the escape time algorithm, but nothing is stored per pixel.
+ */
+vector<long long> Mandelbrot::count_iterations(const std::vector<double> &x_cor, const std::vector<double> &y_cor, const int max_its) {
+    int nr_rows = static_cast<int>(y_cor.size());
+    int nr_cols = static_cast<int>(x_cor.size());
+    vector<long long> its(nr_rows, 0);
+
+    // the rows the kernel would mirror are not iterated there either
+    bool mirrored = conjugate_symmetry && nr_rows >= 2 && y_cor.front() > 0.0 && y_cor.back() < 0.0;
+
+    scheduler.parallel_for(0, nr_rows, 1, [&](int j_begin, int j_end) {
+        for (int j = j_begin; j < j_end; ++j) {
+            double weight = 0.0;
+            if (mirrored && (exact_mirror_row(y_cor, j) >= 0 || (symmetry_resample && resampled_mirror_row(y_cor, j, weight) >= 0))) {
+                continue;
+            }
+            for (int i = 0; i < nr_cols; ++i) {
+                double x = 0.0, y = 0.0;
+                double x2 = 0.0, y2 = 0.0;
+                int n = 0;
+
+                while (x2 + y2 <= bailout && n < max_its) {
+                    y = 2.0 * x * y + y_cor[j];
+                    x = x2 - y2 + x_cor[i];
+                    x2 = x * x;
+                    y2 = y * y;
+                    n++;
+                }
+                its[j] += n;
+            }
+        }
+    });
+
+    return its;
 }
 
 
@@ -90,36 +455,32 @@ vector<cv::Vec3d> Mandelbrot::loadColormap() {
  * Function to apply continuous colormap with interpolation
  * Needed because cv::COLORMAP_TWILIGHT is not continuous!
  * 
- * Variant that maps a whole matrix X with fractional pixel iteration values at once.
+ * Variant that maps a whole matrix with fractional pixel iteration values at once.
 */ 
-void Mandelbrot::applyContinuousColormap(cv::Mat& img_color) {
-
-    int num_colors = static_cast<int>(colormap.size()) - 1;  // -1 since we interpolate between adjacent colors
-    
-    // Loop through each pixel
-    #pragma omp parallel for
-    for (int j = 0; j < X.rows; ++j) {
-        for (int i = 0; i < X.cols; ++i) {
-            // Get normalized value (0 to 1)
-            double value = X.at<double>(j, i) / 255.0;
-
-            // Scale value to [0, num_colors], to find the neighboring indices in the colormap
-            double scaled_value = value * num_colors;
-            int index1 = static_cast<int>(floor(scaled_value));  // Lower index
-            int index2 = min(index1 + 1, num_colors);  // Upper index
-
-            // Fractional part for interpolation
-            double t = scaled_value - index1;
-
-            // Interpolate between color1 and color2 based on 't'
-            cv::Vec3d color1 = colormap[index1];
-            cv::Vec3d color2 = colormap[index2];
-            cv::Vec3d interpolated_color = interpolateColor(color1, color2, t);
-
-            // Set the pixel color
-            img_color.at<cv::Vec3d>(j, i) = interpolated_color;
+void Mandelbrot::applyContinuousColormap(const cv::Mat& iterations, cv::Mat& img_color) {
+    // doubles from the kernel, or floats from an iteration archive
+    bool is_float = iterations.depth() == CV_32F;
+
+    // Loop through each row in parallel; the colorizer costs the same for each pixel, so use bigger units
+    scheduler.parallel_for(0, iterations.rows, 16, [&](int j_begin, int j_end) {
+        for (int j = j_begin; j < j_end; ++j) {
+            const double* n_row = is_float ? nullptr : iterations.ptr<double>(j);
+            const float* n_row_float = is_float ? iterations.ptr<float>(j) : nullptr;
+            cv::Vec3d* color_row = img_color.ptr<cv::Vec3d>(j);
+
+            for (int i = 0; i < iterations.cols; ++i) {
+                double n = is_float ? n_row_float[i] : n_row[i];
+
+                if (n < 0.0) {
+                    // Set to black for those pixels in the set
+                    color_row[i] = {0.0, 0.0, 0.0};
+                } else {
+                    // Take the modulus for cyclic coloring, one cycle of color_cycle iterations spans the colormap
+                    color_row[i] = applyContinuousColormap(fmod(n, color_cycle) * (255.0 / color_cycle));
+                }
+            }
         }
-    }
+    });
 }
 
 /**
@@ -180,6 +541,39 @@ vector<double> Mandelbrot::linspace(double start, double end, int num) {
     return result;
 }
 
+/**
+ * linspace(y + height/2, y - height/2, num) for the rows of a view, the grid of the reference render;
+ * with conjugate_symmetry and symmetry_snap the snapped_y_linspace.
+ */
+vector<double> Mandelbrot::y_linspace(double y, double height, int num) {
+    if (conjugate_symmetry && symmetry_snap) {
+        return snapped_y_linspace(y, height, num);
+    }
+    return linspace(y + height/2.0, y - height/2.0, num);
+}
+
+/**
+ * A view that straddles the real axis, shifted by at most a quarter row so the axis is on a row or halfway between two;
+ * the rows are then (axis_row - j) * step, and rows at the same distance from the axis are exact negatives,
+ * which plan_mirrored_rows mirrors. This moves the picture by up to a quarter row compared to the reference render.
+ * Views away from the axis get the plain linspace.
+ */
+vector<double> Mandelbrot::snapped_y_linspace(double y, double height, int num) {
+    vector<double> y_cor = linspace(y + height/2.0, y - height/2.0, num);
+    if (num < 2 || y_cor.front() <= 0.0 || y_cor.back() >= 0.0) {
+        return y_cor;
+    }
+
+    // the row of the axis, counted from the top row, rounded to a multiple of one half; within [0, num - 1], so exact
+    double step = height / (num - 1);
+    double axis_row = round(2.0 * (y + height/2.0) / step) / 2.0;
+    for (int j = 0; j < num; ++j) {
+        y_cor[j] = (axis_row - j) * step;
+    }
+    return y_cor;
+}
+
+
 /**
  * Function to interpolate between two colors
  */
@@ -1,14 +1,18 @@
 #ifndef MANDELBROT_HPP
 #define MANDELBROT_HPP
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
 
 #include <opencv2/core/mat.hpp>
 #include <opencv2/opencv.hpp>
-#include <omp.h>
 
 #include "settings.hpp"
+#include "task_scheduler.hpp"
+#include "frame_allocator.hpp"
+#include "iteration_state.hpp"
+#include "bla_table.hpp"
 
 using namespace std;
 
@@ -20,12 +24,27 @@ class Mandelbrot {
             nx(settings->x_resolution),
             ny(settings->y_resolution),
             max_its(settings->max_its),
+            color_cycle(settings->color_cycle),
+            use_bla(settings->bla),
+            conjugate_symmetry(settings->conjugate_symmetry),
+            symmetry_resample(settings->symmetry_resample),
+            symmetry_snap(settings->symmetry_snap),
+            scheduler(settings),
+            allocator(settings, &scheduler),
+            bla_table(settings->bla_epsilon),
             colormap(loadColormap()) {
                 // row-major order, so y then x
-                X = cv::Mat(settings->y_resolution, settings->x_resolution, CV_64FC3); 
+                X = allocator.acquire_mat(settings->y_resolution, settings->x_resolution, CV_64FC3, X_buffer); 
+
+                // fractional iteration count per pixel, negative for points inside the set
+                N = allocator.acquire_mat(settings->y_resolution, settings->x_resolution, CV_64FC1, N_buffer);
 
                 // png, jpg etc only support integer color chanels
-                output_image = cv::Mat(settings->y_resolution, settings->x_resolution, CV_8UC3); 
+                output_image = allocator.acquire_mat(settings->y_resolution, settings->x_resolution, CV_8UC3, output_buffer); 
+
+                row_iterations.assign(settings->y_resolution, 0);
+                mirror_source.assign(settings->y_resolution, -1);
+                mirror_weight.assign(settings->y_resolution, 0.0);
             };
         ~Mandelbrot() {};
 
@@ -40,19 +59,75 @@ class Mandelbrot {
 
         // main calculations
         void mandelbrot(const std::vector<double> &x_cor, const std::vector<double> &y_cor, const int max_its);
+        void mandelbrot(const std::vector<double> &x_cor, const std::vector<double> &y_cor, const int max_its, const vector<TaskScheduler::WorkUnit> &units);
+        void mandelbrot(const std::vector<double> &x_cor, const std::vector<double> &y_cor, const int max_its, IterationState &state);
+
+        // perturbation around a reference orbit at the center (x, y) of the view, skipping iterations with the BLA table
+        void mandelbrot_bla(double x, double y, double height, const int max_its, const vector<TaskScheduler::WorkUnit> &units);
+
+        // iterations per row of a (low resolution) view, without touching the frame buffers; used to probe the cost of a frame
+        vector<long long> count_iterations(const std::vector<double> &x_cor, const std::vector<double> &y_cor, const int max_its);
 
         // utilities
         vector<double> linspace(double start, double end, int num);
+
+        // y coordinates of a view, from y + height/2 down to y - height/2; with symmetry_snap snapped so rows mirror exactly
+        vector<double> y_linspace(double y, double height, int num);
+        vector<double> snapped_y_linspace(double y, double height, int num);
         cv::Vec3d interpolateColor(const cv::Vec3d& color1, const cv::Vec3d& color2, double t);
 
     protected:
         cv::Mat X;
+        cv::Mat N;
         cv::Mat output_image;
         const int nx;
         const int ny;
         const int max_its;
+        const double color_cycle;
+
+        // render with mandelbrot_bla instead of the escape time kernel
+        const bool use_bla;
+
+        // mirror rows of the escape time kernel across the real axis; not const, the regression harness switches them per variant
+        bool conjugate_symmetry;
+        bool symmetry_resample;
+        const bool symmetry_snap;
+
+        // used by the kernel, the colorizer and the pipeline stages of the children
+        TaskScheduler scheduler;
+
+        // huge page, first touched memory for the frame and iteration buffers; declared before the buffers, which return to it
+        FrameAllocator allocator;
+        FrameAllocator::Buffer X_buffer;
+        FrameAllocator::Buffer N_buffer;
+        FrameAllocator::Buffer output_buffer;
+
+        // rebuilt for every view by mandelbrot_bla
+        BlaTable bla_table;
+
+        // iterations per row of the last frame, a cost estimate for the rows of the next one
+        vector<long long> row_iterations;
+
+        // per row: the row it is mirrored from (-1: computed), and for a resampled row the weight of mirror_source + 1
+        vector<int> mirror_source;
+        vector<double> mirror_weight;
+
+        // rows of the last render that were mirrored instead of iterated
+        int nr_mirrored_rows = 0;
+
+        // checked by the kernel before every row: a cancelled render stops within a row and skips the colorizer
+        atomic<bool> cancel_requested{false};
+
+        // ApplycontinousColormap in two versions; map an iteration matrix (like N) to an image matrix or apply to a single point
+        void applyContinuousColormap(const cv::Mat& iterations, cv::Mat& img_color);
 
     private:
+        // conjugate symmetry: which rows are mirror images of computed rows, and copying them over after the kernel
+        int exact_mirror_row(const std::vector<double> &y_cor, int j) const;
+        int resampled_mirror_row(const std::vector<double> &y_cor, int j, double &weight) const;
+        int plan_mirrored_rows(const std::vector<double> &y_cor);
+        void fill_mirrored_rows();
+
         const string colormap_name; 
         const vector<cv::Vec3d> colormap;
         
@@ -64,8 +139,7 @@ class Mandelbrot {
          */
         vector<cv::Vec3d> loadColormap();
 
-        // ApplycontinousColormap in two versions; apply to image matrix or apply to a single point
-        void applyContinuousColormap(cv::Mat& img_color);
+        // apply to a single point; the matrix version is protected
         cv::Vec3d applyContinuousColormap(double n_frac);
 };
     
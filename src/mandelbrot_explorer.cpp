@@ -0,0 +1,264 @@
+#include "mandelbrot_explorer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#include "spdlog/spdlog.h"
+
+static const double pan_step = 0.1;        // fraction of the view per key press
+static const double zoom_step = 1.25;      // per key press or wheel notch
+
+
+static int display_width(const Settings* settings) {
+    return (settings->explorer_display_width > 0) ? min(settings->explorer_display_width, settings->x_resolution) : settings->x_resolution;
+}
+
+
+MandelbrotExplorer::MandelbrotExplorer(Settings* settings) :
+    Mandelbrot(settings),
+    start_height(settings->start_height),
+    export_filename(settings->explorer_export_file),
+    start_view({settings->trajectory_vector.at(0)[0], settings->trajectory_vector.at(0)[1], settings->start_height, settings->max_its}),
+    display_nx(display_width(settings)),
+    display_ny(max(1, static_cast<int>(lround(display_width(settings) * (static_cast<double>(settings->y_resolution) / settings->x_resolution))))) {
+        view = start_view;
+        rendered_view = start_view;
+        rendered_image = cv::Mat(display_ny, display_nx, CV_8UC3, cv::Scalar(0, 0, 0));
+
+        render_thread = thread(&MandelbrotExplorer::render_loop, this);
+    };
+
+
+MandelbrotExplorer::~MandelbrotExplorer() {
+    {
+        lock_guard<mutex> lock(request_mutex);
+        quitting = true;
+        cancel_requested = true;
+    }
+    request_cv.notify_one();
+    render_thread.join();
+}
+
+
+/**********************
+ * Render thread
+ **********************/
+
+void MandelbrotExplorer::render_loop() {
+    while (true) {
+        View current;
+        {
+            unique_lock<mutex> lock(request_mutex);
+            request_cv.wait(lock, [this] { return has_request || quitting; });
+            if (quitting) {
+                return;
+            }
+
+            // take the latest request; a cancel set from here on is meant for this render
+            current = requested_view;
+            has_request = false;
+            cancel_requested = false;
+        }
+
+        double width = get_width(current);
+        vector<double> x_cor = linspace(current.x - width/2.0, current.x + width/2.0, nx);
+        vector<double> y_cor = y_linspace(current.y, current.height, ny);
+
+        auto start = chrono::high_resolution_clock::now();
+        if (use_bla) {
+            mandelbrot_bla(current.x, current.y, current.height, current.max_its, vector<TaskScheduler::WorkUnit>());
+        } else {
+            mandelbrot(x_cor, y_cor, current.max_its);
+        }
+        if (cancel_requested.load()) {
+            continue;
+        }
+        X.convertTo(output_image, CV_8UC3, 255.0);
+        auto end = chrono::high_resolution_clock::now();
+
+        {
+            lock_guard<mutex> lock(result_mutex);
+            output_image.copyTo(result_image);
+            result_view = current;
+            result_ready = true;
+        }
+        spdlog::info("Rendered x={:.17g}, y={:.17g}, zoom={:.6g}, max_its={} in {} ms", current.x, current.y,
+            start_height / current.height, current.max_its, chrono::duration_cast<chrono::milliseconds>(end - start).count());
+    }
+}
+
+
+/**
+ * Ask the render thread for the current view, cancelling whatever it is rendering now.
+ */
+void MandelbrotExplorer::request_render() {
+    {
+        lock_guard<mutex> lock(request_mutex);
+        requested_view = view;
+        has_request = true;
+        cancel_requested = true;
+    }
+    request_cv.notify_one();
+}
+
+
+/**********************
+ * UI thread
+ **********************/
+
+void MandelbrotExplorer::run() {
+    cv::namedWindow(window_name, cv::WINDOW_AUTOSIZE);
+    cv::setMouseCallback(window_name, &MandelbrotExplorer::on_mouse, this);
+
+    cv::imshow(window_name, rendered_image);
+    request_render();
+
+    while (true) {
+        // also runs the mouse callback; short, so input is handled well within a frame.
+        // The callbacks only change the view, the preview and the request follow below, once per iteration
+        int key = cv::waitKey(5);
+        if (key >= 0 && !handle_key(key & 0xFF)) {
+            break;
+        }
+
+        // the window was closed
+        if (cv::getWindowProperty(window_name, cv::WND_PROP_VISIBLE) < 1) {
+            break;
+        }
+
+        bool new_result = false;
+        {
+            lock_guard<mutex> lock(result_mutex);
+            if (result_ready) {
+                // once per render, area average down to the window
+                cv::resize(result_image, rendered_image, rendered_image.size(), 0, 0, cv::INTER_AREA);
+                rendered_view = result_view;
+                result_ready = false;
+                new_result = true;
+            }
+        }
+
+        // a result of an older view (still shown as a preview) is resampled as well
+        if (view_changed || new_result) {
+            show_preview();
+        }
+        if (view_changed) {
+            request_render();
+            view_changed = false;
+        }
+    }
+
+    cv::destroyWindow(window_name);
+}
+
+
+/**
+ * Show the last rendered image, resampled from its own view to the current view, at display size.
+ * Parts outside of the rendered view are black until the new render is done.
+ */
+void MandelbrotExplorer::show_preview() {
+    double width = get_width(view);
+    double rendered_width = get_width(rendered_view);
+
+    // affine map from a pixel of the current view to a pixel of the rendered view
+    double scale_x = width / rendered_width;
+    double scale_y = view.height / rendered_view.height;
+    double offset_x = ((view.x - width/2.0) - (rendered_view.x - rendered_width/2.0)) * (display_nx - 1) / rendered_width;
+    double offset_y = ((rendered_view.y + rendered_view.height/2.0) - (view.y + view.height/2.0)) * (display_ny - 1) / rendered_view.height;
+
+    cv::Mat map = (cv::Mat_<double>(2, 3) << scale_x, 0.0, offset_x, 0.0, scale_y, offset_y);
+
+    cv::Mat preview;
+    cv::warpAffine(rendered_image, preview, map, rendered_image.size(),
+        cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0));
+    cv::imshow(window_name, preview);
+}
+
+
+/**
+ * Returns false to quit.
+ */
+bool MandelbrotExplorer::handle_key(int key) {
+    double width = get_width(view);
+
+    switch (key) {
+        case 'q':
+        case 27:    // escape
+            return false;
+        case 'w': view.y += pan_step * view.height; break;
+        case 's': view.y -= pan_step * view.height; break;
+        case 'a': view.x -= pan_step * width; break;
+        case 'd': view.x += pan_step * width; break;
+        case '+':
+        case '=': view.height /= zoom_step; break;
+        case '-': view.height *= zoom_step; break;
+        case ']': view.max_its *= 2; break;
+        case '[': view.max_its = max(1, view.max_its / 2); break;
+        case 'r': view = start_view; break;
+        case 'e': export_view(); return true;
+        default: return true;
+    }
+
+    view_changed = true;
+    return true;
+}
+
+
+void MandelbrotExplorer::handle_mouse(int event, int px, int py, int flags) {
+    double width = get_width(view);
+
+    if (event == cv::EVENT_LBUTTONDOWN) {
+        dragging = true;
+        drag_x = px;
+        drag_y = py;
+        return;
+    } else if (event == cv::EVENT_LBUTTONUP) {
+        dragging = false;
+        return;
+    } else if (event == cv::EVENT_MOUSEMOVE && dragging && (flags & cv::EVENT_FLAG_LBUTTON)) {
+        // move the view with the mouse; px and py are window (display) pixels
+        view.x -= (px - drag_x) * width / (display_nx - 1);
+        view.y += (py - drag_y) * view.height / (display_ny - 1);
+        drag_x = px;
+        drag_y = py;
+    } else if (event == cv::EVENT_MOUSEWHEEL) {
+        // zoom around the cursor: the point under the cursor stays where it is
+        double factor = (cv::getMouseWheelDelta(flags) > 0) ? 1.0 / zoom_step : zoom_step;
+        double cursor_x = view.x - width/2.0 + px * width / (display_nx - 1);
+        double cursor_y = view.y + view.height/2.0 - py * view.height / (display_ny - 1);
+
+        view.x = cursor_x + (view.x - cursor_x) * factor;
+        view.y = cursor_y + (view.y - cursor_y) * factor;
+        view.height *= factor;
+    } else {
+        return;
+    }
+
+    view_changed = true;
+}
+
+
+void MandelbrotExplorer::on_mouse(int event, int px, int py, int flags, void* explorer) {
+    static_cast<MandelbrotExplorer*>(explorer)->handle_mouse(event, px, py, flags);
+}
+
+
+/**
+ * Append the view as a trajectory point, in the format of the trajectory in settings.yaml.
+ */
+void MandelbrotExplorer::export_view() {
+    char point[128];
+    snprintf(point, sizeof(point), "  - [ %.17g, %.17g, %.17g ]", view.x, view.y, start_height / view.height);
+
+    ofstream file(export_filename, ios::app);
+    if (!file) {
+        cerr << "Could not open " << export_filename << endl;
+        return;
+    }
+    file << point << "\n";
+
+    spdlog::info("Exported trajectory point to {}: {}", export_filename, point);
+}
@@ -0,0 +1,90 @@
+#ifndef MANDELBROT_EXPLORER_HPP
+#define MANDELBROT_EXPLORER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+
+#include "settings.hpp"
+#include "mandelbrot.hpp"
+
+using namespace std;
+
+/**
+ * Interactive explorer in an OpenCV window.
+ *
+ * The UI thread (run) handles mouse and keyboard input and never waits for a render.
+ * The input callbacks only change the view; once per loop iteration, if the view changed, run shows the last rendered image
+ * resampled to the new view, cancels the render in flight (the kernel stops at the next row) and requests a new one.
+ * A burst of mouse moves between two iterations is a single preview and a single request.
+ * Renders are downsampled once to the window size (explorer_display_width), so previews are warped at that size.
+ * A separate render thread always renders the most recent view that was requested.
+ *
+ * Controls:
+ *  - drag with the left mouse button or w/a/s/d: pan
+ *  - mouse wheel or +/-: zoom (the wheel zooms around the cursor)
+ *  - [ / ]: halve / double max_its
+ *  - e: export the current view as a trajectory point [x, y, zoom] to explorer_export_file
+ *  - r: reset the view, q or escape: quit
+ */
+class MandelbrotExplorer : public Mandelbrot {
+    public:
+        MandelbrotExplorer(Settings* settings);
+        ~MandelbrotExplorer();
+
+        void run() override;
+
+    private:
+        struct View {
+            double x;
+            double y;
+            double height;
+            int max_its;
+        };
+
+        const string window_name = "Mandelbrot Explorer";
+        const double start_height;
+        const string export_filename;
+        const View start_view;
+        const int display_nx;
+        const int display_ny;
+
+        // UI thread only; rendered_image is at display size
+        View view;
+        bool view_changed = false;
+        View rendered_view;
+        cv::Mat rendered_image;
+        bool dragging = false;
+        int drag_x = 0;
+        int drag_y = 0;
+
+        // hand over of views to the render thread; cancel_requested is set and reset under request_mutex too
+        thread render_thread;
+        mutex request_mutex;
+        condition_variable request_cv;
+        View requested_view;
+        bool has_request = false;
+        bool quitting = false;
+
+        // hand over of finished renders to the UI thread
+        mutex result_mutex;
+        cv::Mat result_image;
+        View result_view;
+        bool result_ready = false;
+
+        void render_loop();
+        void request_render();
+        void show_preview();
+        void export_view();
+
+        double get_width(const View& v) const { return v.height * (static_cast<double>(nx) / ny); };
+
+        bool handle_key(int key);
+        void handle_mouse(int event, int px, int py, int flags);
+        static void on_mouse(int event, int px, int py, int flags, void* explorer);
+};
+
+#endif
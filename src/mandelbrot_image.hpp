@@ -14,7 +14,9 @@ class MandelbrotImage : public Mandelbrot {
             x(settings->trajectory_vector.at(0)[0]),
             y(settings->trajectory_vector.at(0)[1]),
             width(settings->start_width),
-            height(settings->start_height) 
+            height(settings->start_height),
+            resume_iterations(settings->resume_iterations),
+            iteration_state_file(settings->iteration_state_file)
             {};
 
         void run() override {
@@ -27,13 +29,41 @@ class MandelbrotImage : public Mandelbrot {
 
             // Covert pixels to mandelbrot set coords
             vector<double> x_cor = linspace(x-width/2.0, x+width/2.0, nx);
-            vector<double> y_cor = linspace(y+height/2.0, y-height/2.0, ny); // from + to -, y order is other way around compared to matplotlib
+            vector<double> y_cor = y_linspace(y, height, ny); // from + to -, y order is other way around compared to matplotlib
             timer.timeit("linspace()", t_0);
 
             // main calculation
             auto t_1 = high_resolution_clock::now();
-            mandelbrot(x_cor, y_cor, max_its);
-            timer.timeit("mandelbrot()", t_1);    
+            if (resume_iterations) {
+                if (use_bla || conjugate_symmetry) {
+                    spdlog::warn("resume_iterations renders with the plain escape time kernel, bla and conjugate_symmetry are not used");
+                }
+
+                // continue from the iteration state of an earlier render of this view, if there is one;
+                // a state iterated beyond max_its has pixels in the set that escape later, so that starts over
+                IterationState state(nx, ny);
+                if (state.load(iteration_state_file) && state.matches(x_cor, y_cor) && state.max_its <= max_its) {
+                    spdlog::info("Resuming from {} (max_its {}), {} pixels left to iterate", 
+                        iteration_state_file, state.max_its, state.count_unescaped(max_its));
+                } else {
+                    state.reset(x_cor, y_cor);
+                }
+                timer.timeit("load iteration state", t_1);
+
+                auto t_2 = high_resolution_clock::now();
+                mandelbrot(x_cor, y_cor, max_its, state);
+                timer.timeit("mandelbrot()", t_2);
+
+                auto t_4 = high_resolution_clock::now();
+                state.save(iteration_state_file);
+                timer.timeit("save iteration state", t_4);
+            } else if (use_bla) {
+                mandelbrot_bla(x, y, height, max_its, vector<TaskScheduler::WorkUnit>());
+                timer.timeit("mandelbrot_bla()", t_1);
+            } else {
+                mandelbrot(x_cor, y_cor, max_its);
+                timer.timeit("mandelbrot()", t_1);    
+            }
 
             // png, jpg etc only support integer color chanels, so convert
             auto t_3 = high_resolution_clock::now();
@@ -47,6 +77,7 @@ class MandelbrotImage : public Mandelbrot {
             timer.timeit("cv::imwrite(), imshow()", t_3);
             timer.timeit("main()", t_0);
             timer.logTime();
+            scheduler.log_worker_stats();
         };
 
     private:
@@ -54,6 +85,8 @@ class MandelbrotImage : public Mandelbrot {
         double y;
         double width;
         double height;
+        const bool resume_iterations;
+        const string iteration_state_file;
 };
 
 #endif
\ No newline at end of file
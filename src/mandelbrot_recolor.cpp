@@ -0,0 +1,59 @@
+#include "mandelbrot_recolor.hpp"
+
+#include <chrono>
+#include <future>
+
+#include "spdlog/spdlog.h"
+
+
+void MandelbrotRecolor::run() {
+    auto start = chrono::high_resolution_clock::now();
+    int nr_frames = archive->get_nr_frames();
+
+    cv::VideoWriter videoWriter;
+    int codec = cv::VideoWriter::fourcc('m', 'p', '4', 'v');  // Codec for MP4 (using 'MP4V')
+    videoWriter.open(output_filename, codec, fps, cv::Size(nx, ny), true);
+    if (!videoWriter.isOpened()) {
+        cerr << "Could not open the video writer!" << endl;
+        return;
+    }
+
+    // inflated frames go here; raw frames are read in place
+    FrameAllocator::Buffer field_buffer;
+    cv::Mat field = allocator.acquire_mat(ny, nx, CV_32FC1, field_buffer);
+
+    // two output images: one is encoded while the next frame is colorized into the other
+    FrameAllocator::Buffer second_output_buffer;
+    cv::Mat output_images[2] = {output_image, allocator.acquire_mat(ny, nx, CV_8UC3, second_output_buffer)};
+    future<void> encoding;
+
+    for (int i = 0; i < nr_frames; ++i) {
+        cv::Mat iterations = archive->read_frame(i, field, &scheduler);
+        applyContinuousColormap(iterations, X);
+
+        // the last user of this image is frame i-2, which was encoded before frame i-1 was handed to the encoder
+        cv::Mat frame = output_images[i % 2];
+        X.convertTo(frame, CV_8UC3, 255.0);
+
+        // one frame in the encoder at a time, to keep the frames in order
+        if (encoding.valid()) {
+            encoding.get();
+        }
+        encoding = scheduler.submit([&videoWriter, frame]() { 
+            videoWriter.write(frame); 
+        });
+
+        printf("%.2f%% recolored", (static_cast<float>(i + 1) / nr_frames) * 100);
+        cout << endl; // to flush
+    }
+
+    if (encoding.valid()) {
+        encoding.get();
+    }
+    videoWriter.release();
+
+    auto end = chrono::high_resolution_clock::now();
+    double elapsed = chrono::duration_cast<chrono::milliseconds>(end - start).count() / 1000.0;
+    spdlog::info("Recolored {} frames to {} in {:.2f}s ({:.1f} fps)", nr_frames, output_filename, elapsed, nr_frames / max(elapsed, 1e-3));
+    scheduler.log_worker_stats();
+}
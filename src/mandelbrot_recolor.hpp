@@ -0,0 +1,32 @@
+#ifndef MANDELBROT_RECOLOR_HPP
+#define MANDELBROT_RECOLOR_HPP
+
+#include "settings.hpp"
+#include "mandelbrot.hpp"
+#include "iteration_archive.hpp"
+
+using namespace std;
+
+/**
+ * Recolor a video from its iteration archive: no iterations, only the colorizer and the encoder.
+ * The colormap and color_cycle come from the settings, the resolution from the archive.
+ *
+ * Pipeline per frame: read (in place, or inflate) -> colorize -> convert, while the encoder writes the previous frame.
+ */
+class MandelbrotRecolor : public Mandelbrot {
+    public:
+        MandelbrotRecolor(Settings* settings, IterationArchiveReader* archive) : 
+            Mandelbrot(settings),
+            archive(archive),
+            fps(settings->fps),
+            output_filename(settings->output_filename + "_recolor.mp4") {};
+
+        void run() override;
+
+    private:
+        IterationArchiveReader* archive;
+        const int fps;
+        const string output_filename;
+};
+
+#endif
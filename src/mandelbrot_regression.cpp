@@ -0,0 +1,271 @@
+#include "mandelbrot_regression.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "spdlog/spdlog.h"
+
+#include "iteration_state.hpp"
+#include "render_planner.hpp"
+
+static const char golden_magic[4] = {'M', 'B', 'G', 'N'};
+
+
+MandelbrotRegression::MandelbrotRegression(Settings* settings) :
+    Mandelbrot(settings),
+    golden_directory(settings->golden_directory),
+    update_golden(settings->update_golden),
+    repeats(max(1, settings->regression_repeats)),
+    max_mismatch_fraction(settings->regression_max_mismatch),
+    max_mean_delta_e(settings->regression_max_delta_e) {
+
+    // the catalogue: {name, x, y, height, max_its}
+    scenes = {
+        {"full_set", -0.5, 0.0, 3.0, 500},
+        {"real_axis_offset", -0.75, 0.0123, 0.5, 1000},
+        {"seahorse_valley", -0.743643887037151, 0.131825904205330, 0.01, 2000},
+        {"elephant_valley", 0.275, 0.006, 0.02, 1000},
+        {"needle_minibrot", -1.7686, 0.0, 0.001, 3000},
+        {"trajectory_end_1e8", 0.3602404434377, -0.6413130610647635, 3.0 / 1e8, 4000},
+    };
+
+    // the golden buffers and the other variants iterate every row; the symmetry variants switch it on for themselves
+    conjugate_symmetry = false;
+    symmetry_resample = false;
+
+    // every kernel variant has to reproduce the golden buffers of the reference kernel
+    variants.push_back({"reference", [this](const vector<double>& x_cor, const vector<double>& y_cor, int its) {
+        mandelbrot(x_cor, y_cor, its);
+    }, max_mismatch_fraction});
+
+    // cost ordered work units from the iterations per row of the previous render
+    variants.push_back({"planned_units", [this, settings](const vector<double>& x_cor, const vector<double>& y_cor, int its) {
+        RenderPlanner planner(settings);
+        mandelbrot(x_cor, y_cor, its, planner.make_work_units(0, row_iterations, scheduler.get_nr_threads()));
+    }, max_mismatch_fraction});
+
+    // half of the iterations, then resumed to all of them
+    variants.push_back({"resumed_state", [this](const vector<double>& x_cor, const vector<double>& y_cor, int its) {
+        IterationState state(nx, ny);
+        state.reset(x_cor, y_cor);
+        mandelbrot(x_cor, y_cor, its / 2, state);
+        mandelbrot(x_cor, y_cor, its, state);
+    }, max_mismatch_fraction});
+
+    // rows mirrored across the real axis; exact mirror images only, so identical
+    variants.push_back({"conjugate_symmetry", [this](const vector<double>& x_cor, const vector<double>& y_cor, int its) {
+        conjugate_symmetry = true;
+        mandelbrot(x_cor, y_cor, its);
+        conjugate_symmetry = false;
+    }, max_mismatch_fraction});
+
+    // the production path of symmetry_snap: the view shifted so all rows of the band mirror exactly, again identical
+    variants.push_back({"symmetry_snap", [this](const vector<double>& x_cor, const vector<double>& y_cor, int its) {
+        conjugate_symmetry = true;
+        mandelbrot(x_cor, y_cor, its);
+        conjugate_symmetry = false;
+    }, max_mismatch_fraction, true});
+
+    // and the rows in between, interpolated
+    variants.push_back({"symmetry_resample", [this](const vector<double>& x_cor, const vector<double>& y_cor, int its) {
+        conjugate_symmetry = true;
+        symmetry_resample = true;
+        mandelbrot(x_cor, y_cor, its);
+        conjugate_symmetry = false;
+        symmetry_resample = false;
+    }, settings->regression_max_mismatch_resample});
+
+    // perturbation around the center with BLA jumps; it takes the view, which the linspaces span
+    variants.push_back({"bla", [this](const vector<double>& x_cor, const vector<double>& y_cor, int its) {
+        mandelbrot_bla((x_cor.front() + x_cor.back()) / 2.0, (y_cor.front() + y_cor.back()) / 2.0, y_cor.front() - y_cor.back(),
+            its, vector<TaskScheduler::WorkUnit>());
+    }, settings->regression_max_mismatch_bla});
+}
+
+
+void MandelbrotRegression::run() {
+    spdlog::info("Kernel regression: {} scenes, {} variants at {}x{}", scenes.size(), variants.size(), nx, ny);
+
+    printf("%-20s %-16s %10s %8s %10s %10s %10s %8s %8s  %s\n",
+        "scene", "variant", "time (ms)", "speedup", "max err", "mean err", "mismatch", "mean dE", "max dE", "result");
+
+    for (const Scene& scene : scenes) {
+        double width = scene.height * (static_cast<double>(nx) / ny);
+        vector<double> x_cor = linspace(scene.x - width/2.0, scene.x + width/2.0, nx);
+        vector<double> y_cor = linspace(scene.y + scene.height/2.0, scene.y - scene.height/2.0, ny);
+
+        // the grid of symmetry_snap; a view that straddles the real axis has a golden buffer for that grid as well
+        vector<double> snapped_y_cor = snapped_y_linspace(scene.y, scene.height, ny);
+        bool snapped = snapped_y_cor != y_cor;
+
+        // golden buffers; only rendered on request, a kernel under test never becomes its own reference
+        cv::Mat golden, snapped_golden;
+        if (!golden_buffer(scene.name, x_cor, y_cor, scene.max_its, golden) ||
+            (snapped && !golden_buffer(scene.name + "_snapped", x_cor, snapped_y_cor, scene.max_its, snapped_golden))) {
+            all_passed = false;
+            continue;
+        }
+
+        double reference_ms = 0.0;
+        for (const Variant& variant : variants) {
+            // best of repeats
+            double best_ms = 0.0;
+            bool on_snapped_grid = variant.snapped_grid && snapped;
+            for (int r = 0; r < repeats; ++r) {
+                auto start = chrono::high_resolution_clock::now();
+                variant.render(x_cor, on_snapped_grid ? snapped_y_cor : y_cor, scene.max_its);
+                auto end = chrono::high_resolution_clock::now();
+
+                double ms = chrono::duration_cast<chrono::microseconds>(end - start).count() / 1000.0;
+                best_ms = (r == 0) ? ms : min(best_ms, ms);
+            }
+            if (variant.name == "reference") {
+                reference_ms = best_ms;
+            }
+
+            ErrorMetrics metrics = compare(N, on_snapped_grid ? snapped_golden : golden);
+            bool passed = metrics.mismatch_fraction <= variant.max_mismatch_fraction && metrics.mean_delta_e <= max_mean_delta_e;
+            all_passed = all_passed && passed;
+
+            printf("%-20s %-16s %10.1f %7.2fx %10.3g %10.3g %9.4f%% %8.3f %8.2f  %s\n",
+                scene.name.c_str(), variant.name.c_str(), best_ms, (best_ms > 0 && reference_ms > 0) ? reference_ms / best_ms : 0.0,
+                metrics.max_abs_error, metrics.mean_abs_error, metrics.mismatch_fraction * 100.0,
+                metrics.mean_delta_e, metrics.max_delta_e, passed ? "PASS" : "FAIL");
+        }
+    }
+    cout << endl;
+
+    if (all_passed) {
+        spdlog::info("All kernel variants match the golden buffers");
+    } else {
+        spdlog::error("Kernel regression: at least one variant exceeds the error thresholds (mismatch {}%, mean dE {})",
+            max_mismatch_fraction * 100.0, max_mean_delta_e);
+    }
+}
+
+
+/**
+ * Per pixel iteration errors and a perceptual diff of the colored images.
+ * N is compared as is; the colors are compared in CIE Lab, where a delta E of about 1 is just noticeable.
+ */
+MandelbrotRegression::ErrorMetrics MandelbrotRegression::compare(const cv::Mat& iterations, const cv::Mat& golden) {
+    ErrorMetrics metrics = {0.0, 0.0, 0.0, 0.0, 0.0};
+    double sum_abs_error = 0.0;
+    long long nr_mismatched = 0;
+
+    for (int j = 0; j < ny; ++j) {
+        const double* n_row = iterations.ptr<double>(j);
+        const double* golden_row = golden.ptr<double>(j);
+
+        for (int i = 0; i < nx; ++i) {
+            bool inside = n_row[i] < 0.0;
+            bool golden_inside = golden_row[i] < 0.0;
+
+            // a pixel on the wrong side of the set is off by the iterations of the escaped one; take the raw difference elsewhere
+            double error = (inside == golden_inside) ? fabs(n_row[i] - golden_row[i]) : max(fabs(n_row[i]), fabs(golden_row[i]));
+
+            sum_abs_error += error;
+            metrics.max_abs_error = max(metrics.max_abs_error, error);
+            nr_mismatched += (inside != golden_inside || error > 0.5) ? 1 : 0;
+        }
+    }
+
+    double nr_pixels = static_cast<double>(nx) * ny;
+    metrics.mean_abs_error = sum_abs_error / nr_pixels;
+    metrics.mismatch_fraction = nr_mismatched / nr_pixels;
+
+    // perceptual diff; float images in [0, 1] are converted to L in [0, 100] and a, b in about [-127, 127]
+    cv::Mat golden_color(ny, nx, CV_64FC3);
+    applyContinuousColormap(golden, golden_color);
+
+    cv::Mat color_f, golden_color_f, lab, golden_lab;
+    X.convertTo(color_f, CV_32FC3);
+    golden_color.convertTo(golden_color_f, CV_32FC3);
+    cv::cvtColor(color_f, lab, cv::COLOR_BGR2Lab);
+    cv::cvtColor(golden_color_f, golden_lab, cv::COLOR_BGR2Lab);
+
+    double sum_delta_e = 0.0;
+    for (int j = 0; j < ny; ++j) {
+        const cv::Vec3f* lab_row = lab.ptr<cv::Vec3f>(j);
+        const cv::Vec3f* golden_lab_row = golden_lab.ptr<cv::Vec3f>(j);
+
+        for (int i = 0; i < nx; ++i) {
+            double dl = lab_row[i][0] - golden_lab_row[i][0];
+            double da = lab_row[i][1] - golden_lab_row[i][1];
+            double db = lab_row[i][2] - golden_lab_row[i][2];
+            double delta_e = sqrt(dl * dl + da * da + db * db);
+
+            sum_delta_e += delta_e;
+            metrics.max_delta_e = max(metrics.max_delta_e, delta_e);
+        }
+    }
+    metrics.mean_delta_e = sum_delta_e / nr_pixels;
+
+    return metrics;
+}
+
+
+/**
+ * The golden buffer of a view: loaded, or with update_golden rendered by the reference kernel and saved.
+ */
+bool MandelbrotRegression::golden_buffer(const string& name, const vector<double>& x_cor, const vector<double>& y_cor, int max_its, cv::Mat& golden) {
+    string golden_filename = golden_directory + "/" + name + ".bin";
+    if (update_golden) {
+        mandelbrot(x_cor, y_cor, max_its);
+        golden = N.clone();
+        if (save_golden(golden_filename, golden)) {
+            spdlog::info("Wrote golden buffer {}", golden_filename);
+        }
+        return true;
+    }
+    if (!load_golden(golden_filename, golden)) {
+        spdlog::error("No golden buffer {}, render them with update_golden: true and the baseline kernel", golden_filename);
+        return false;
+    }
+    return true;
+}
+
+
+bool MandelbrotRegression::load_golden(const string& filename, cv::Mat& golden) {
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        spdlog::error("Could not read golden buffer {}", filename);
+        return false;
+    }
+
+    char magic[4];
+    int32_t size[2];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(size), sizeof(size));
+    if (!file || memcmp(magic, golden_magic, sizeof(magic)) != 0 || size[0] != nx || size[1] != ny) {
+        spdlog::error("{} is not a golden buffer of {}x{}", filename, nx, ny);
+        return false;
+    }
+
+    golden = cv::Mat(ny, nx, CV_64FC1);
+    for (int j = 0; j < ny; ++j) {
+        file.read(reinterpret_cast<char*>(golden.ptr<double>(j)), nx * sizeof(double));
+    }
+    return static_cast<bool>(file);
+}
+
+
+bool MandelbrotRegression::save_golden(const string& filename, const cv::Mat& golden) {
+    filesystem::create_directories(golden_directory);
+
+    ofstream file(filename, ios::binary);
+    if (!file) {
+        spdlog::error("Could not write golden buffer {}", filename);
+        return false;
+    }
+
+    int32_t size[2] = {nx, ny};
+    file.write(golden_magic, sizeof(golden_magic));
+    file.write(reinterpret_cast<const char*>(size), sizeof(size));
+    for (int j = 0; j < ny; ++j) {
+        file.write(reinterpret_cast<const char*>(golden.ptr<double>(j)), nx * sizeof(double));
+    }
+    return static_cast<bool>(file);
+}
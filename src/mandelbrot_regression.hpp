@@ -0,0 +1,81 @@
+#ifndef MANDELBROT_REGRESSION_HPP
+#define MANDELBROT_REGRESSION_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "settings.hpp"
+#include "mandelbrot.hpp"
+
+using namespace std;
+
+/**
+ * Accuracy and performance regression harness for the kernel variants.
+ *
+ * Renders a catalogue of reference scenes with every kernel variant, and compares the iteration buffer N
+ * to the golden buffer of the scene, which is rendered by the reference kernel (Mandelbrot::mandelbrot).
+ * Golden buffers are committed in golden_directory and only rewritten with update_golden;
+ * a missing one, or one of another resolution, fails the run. A scene that straddles the real axis also has a golden buffer
+ * on the grid of symmetry_snap (<scene>_snapped.bin), shifted by up to a quarter row, for the variants that render on it.
+ *
+ * Per variant and scene it reports the time next to
+ * - iteration errors: max and mean |N - N_golden| and the fraction of mismatched pixels
+ *   (in/out of the set differs, or more than half an iteration off)
+ * - a perceptual diff: mean and max CIE76 delta E between the colored images, in Lab
+ * A variant fails if the mismatch fraction or the mean delta E exceed the thresholds in the settings.
+ * Variants that round differently than the reference kernel (perturbation) have their own mismatch threshold:
+ * near the boundary of the set, a difference in the last bit grows to a different iteration count within a few hundred iterations.
+ */
+class MandelbrotRegression : public Mandelbrot {
+    public:
+        MandelbrotRegression(Settings* settings);
+
+        void run() override;
+
+        // false if any variant exceeded the error thresholds on any scene
+        bool passed() const { return all_passed; };
+
+    private:
+        struct Scene {
+            string name;
+            double x;
+            double y;
+            double height;
+            int max_its;
+        };
+
+        // a variant renders the view into N (and X); a snapped_grid variant gets the rows of symmetry_snap,
+        // and is compared to the golden buffer of that grid
+        struct Variant {
+            string name;
+            function<void(const vector<double>&, const vector<double>&, int)> render;
+            double max_mismatch_fraction;
+            bool snapped_grid = false;
+        };
+
+        struct ErrorMetrics {
+            double max_abs_error;
+            double mean_abs_error;
+            double mismatch_fraction;
+            double mean_delta_e;
+            double max_delta_e;
+        };
+
+        const string golden_directory;
+        const bool update_golden;
+        const int repeats;
+        const double max_mismatch_fraction;
+        const double max_mean_delta_e;
+
+        vector<Scene> scenes;
+        vector<Variant> variants;
+        bool all_passed = true;
+
+        bool golden_buffer(const string& name, const vector<double>& x_cor, const vector<double>& y_cor, int max_its, cv::Mat& golden);
+        bool load_golden(const string& filename, cv::Mat& golden);
+        bool save_golden(const string& filename, const cv::Mat& golden);
+        ErrorMetrics compare(const cv::Mat& iterations, const cv::Mat& golden);
+};
+
+#endif
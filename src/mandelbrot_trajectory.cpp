@@ -136,4 +136,38 @@ void Trajectory::set_interpolation_parameters() {
 double Trajectory::corrected_interpolation(double x0, double x1, double f_xy, double f_err) {
     double f_corr = (f_err - f_xy) / (f_err - 1);
     return x0 * f_corr + x1 * (1 - f_corr);
+};
+
+
+/**
+ * Precompute the view of every frame, such that frames can be looked at out of order (e.g. by the render planner).
+ * Follows exactly the same sequence of multiplications as frame by frame animation would.
+ */
+void Trajectory::set_frame_views() {
+    double width = get_trajectory_point(0).target_width;
+    double height = get_trajectory_point(0).target_height;
+    InterpolationParameters ips = interpolation_parameters[0];
+    int j = 1;
+
+    for (int i = 0; i < nr_frames; ++i) {
+        // get new trajectory simulation parameters at a trajectory change (except if it is the end of simulation)!
+        if (i == trajectory_change_at_frame_numbers[j] && 
+            i != trajectory_change_at_frame_numbers.back()) {
+            ips = interpolation_parameters[j];
+            j += 1;
+        };
+
+        FrameView view;
+        view.x = corrected_interpolation(ips.start.x, ips.end.x, ips.f_xy, ips.f_err);
+        view.y = corrected_interpolation(ips.start.y, ips.end.y, ips.f_xy, ips.f_err);
+        view.width = width;
+        view.height = height;
+        view.trajectory_nr = j - 1;
+        frame_views.push_back(view);
+
+        // adjust the main parameters for the next frame
+        ips.f_xy *= ips.r_xy;
+        width *= r_dim;
+        height *= r_dim;
+    }
 };
\ No newline at end of file
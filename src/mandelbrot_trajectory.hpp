@@ -21,6 +21,8 @@ class Trajectory {
 
                 // I leave this to be set outside the constructor, such that we can change f_xy
                 set_interpolation_parameters();
+
+                set_frame_views();
             };
 
         const int nr_frames;
@@ -54,8 +56,18 @@ class Trajectory {
             double target_height;
         };
 
+        // the view of a single frame, and the index of the trajectory it is on
+        struct FrameView {
+            double x;
+            double y;
+            double width;
+            double height;
+            int trajectory_nr;
+        };
+
         vector<InterpolationParameters> interpolation_parameters;
         vector<int> trajectory_change_at_frame_numbers;
+        vector<FrameView> frame_views;
 
         double corrected_interpolation(double x0, double x1, double f_xy, double f_err);
         TrajectoryPoint get_trajectory_point(size_t i);
@@ -68,6 +80,8 @@ class Trajectory {
         void set_trajectory_change_at_frame_numbers();
 
         void set_interpolation_parameters();
+
+        void set_frame_views();
 };
 
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "mandelbrot_video.hpp"
 #include "settings.hpp"
 
+#include <future>
+
 /*********************
  * Animation utilities
  *********************/
@@ -27,6 +29,56 @@ int MandelbrotVideo::get_current_max_its(int current_frame_nr) {
 };
 
 
+/**
+ * Planning pass: probe a sample of frames at low resolution and fit the cost model of the planner,
+ * to predict the total render time before starting.
+ */
+void MandelbrotVideo::plan() {
+    auto start_planning = chrono::high_resolution_clock::now();
+
+    int px = max(1, nx / planner.probe_scale);
+    int py = max(1, ny / planner.probe_scale);
+    double pixel_ratio = (static_cast<double>(nx) * ny) / (static_cast<double>(px) * py);
+
+    for (int frame_nr : planner.get_probe_frames()) {
+        const FrameView& view = frame_views[frame_nr];
+        vector<double> x_cor = linspace(view.x - view.width/2.0, view.x + view.width/2.0, px);
+        vector<double> y_cor = y_linspace(view.y, view.height, py);
+
+        auto start_probe = chrono::high_resolution_clock::now();
+        vector<long long> probe_row_iterations = count_iterations(x_cor, y_cor, get_current_max_its(frame_nr));
+        auto end_probe = chrono::high_resolution_clock::now();
+
+        double probe_iterations = 0;
+        for (long long its : probe_row_iterations) {
+            probe_iterations += its;
+        }
+
+        // every full resolution row takes the cost of the probe row it falls in, for nx instead of px pixels
+        vector<long long> row_costs(ny);
+        for (int j = 0; j < ny; ++j) {
+            int probe_row = min(py - 1, static_cast<int>(static_cast<long long>(j) * py / ny));
+            row_costs[j] = llround(probe_row_iterations[probe_row] * static_cast<double>(nx) / px);
+        }
+
+        double probe_seconds = chrono::duration_cast<chrono::microseconds>(end_probe - start_probe).count() / 1e6;
+        planner.add_probe(frame_nr, probe_iterations * pixel_ratio, probe_iterations, probe_seconds, row_costs);
+    }
+    planner.fit();
+
+    auto end_planning = chrono::high_resolution_clock::now();
+    double planning_seconds = chrono::duration_cast<chrono::milliseconds>(end_planning - start_planning).count() / 1000.0;
+
+    double total_iterations = 0;
+    for (int i = 0; i < nr_frames; ++i) {
+        total_iterations += planner.get_estimated_iterations(i);
+    }
+    printf("Planned %d frames in %.2fs: %.3g iterations, predicted kernel time %s", 
+        nr_frames, planning_seconds, total_iterations, RenderPlanner::format_duration(planner.get_predicted_total_seconds()).c_str());
+    cout << endl;
+}
+
+
 /**********************
  * Main class functions
  **********************/
@@ -63,41 +115,81 @@ void MandelbrotVideo::run() {
         }
     }
 
-    // variable initialisation
-    double width = get_trajectory_point(0).target_width;
-    double height = get_trajectory_point(0).target_height;
-    InterpolationParameters ips = interpolation_parameters[0];
-    int j = 1;
+    // extra outputs (proxy, thumbnails), downsampled from the colors of the frame (X)
+    vector<unique_ptr<OutputTarget>> targets;
+    if (render) {
+        for (const Settings::Output& output : outputs) {
+            auto target = make_unique<OutputTarget>(output, nx, ny, fps, nr_frames, &allocator);
+            if (target->open()) {
+                targets.push_back(move(target));
+            }
+        }
+    }
+    if (!targets.empty() && target_frame.empty()) {
+        target_frame = allocator.acquire_mat(ny, nx, CV_64FC3, target_frame_buffer);
+    }
+    vector<future<void>> target_writes;
+
+    if (planner.enabled) {
+        plan();
+    }
+
+    // keep the iteration fields, to recolor the video later with mandelbrot_recolor;
+    // a frame is archived from a copy of N, next to the kernel of the following frame
+    unique_ptr<IterationArchiveWriter> archive;
+    FrameAllocator::Buffer archive_buffer;
+    cv::Mat archive_iterations;
+    future<bool> archive_write;
+    if (!iteration_archive.empty()) {
+        archive = make_unique<IterationArchiveWriter>(iteration_archive, nx, ny, archive_chunk_rows, &scheduler);
+        archive_iterations = allocator.acquire_mat(ny, nx, CV_64FC1, archive_buffer);
+    }
+
+    // no cost estimate per row of a rendered frame before the first frame, only that of its probe
+    fill(row_iterations.begin(), row_iterations.end(), 0);
 
     // Call the main animation looper 
     // (merge of frame_helper and frame_builder compared to the Python version)
     for (int i = 0; i < nr_frames; ++i) {  
         auto start_it = chrono::high_resolution_clock::now();
         
-        // get new trajectory simulation parameters at a trajectory change (except if it is the end of simulation)!
-        if (i == trajectory_change_at_frame_numbers[j] && 
-            i != trajectory_change_at_frame_numbers.back()) {
-            ips = interpolation_parameters[j];
-            j += 1;
+        // the views of all frames are precomputed by the Trajectory
+        const FrameView& view = frame_views[i];
+        if (i > 0 && view.trajectory_nr != frame_views[i - 1].trajectory_nr) {
             cout << "Change of trajectory!\n";
         };
 
-        double x = corrected_interpolation(ips.start.x, ips.end.x, ips.f_xy, ips.f_err);
-        double y = corrected_interpolation(ips.start.y, ips.end.y, ips.f_xy, ips.f_err);
         int current_max_its = get_current_max_its(i);
 
         // Create a 'corrected' x and y linspace with sizes of the resolution and values within the mandelbrot domain of interest.
-        vector<double> x_cor = linspace(x-width/2.0, x+width/2.0, nx);
-        vector<double> y_cor = linspace(y+height/2.0, y-height/2.0, ny); // from + to -, y order is other way around compared to matplotlib
+        vector<double> x_cor = linspace(view.x-view.width/2.0, view.x+view.width/2.0, nx);
+        vector<double> y_cor = y_linspace(view.y, view.height, ny); // from + to -, y order is other way around compared to matplotlib
+
+        // main mandelbrot calculation; consecutive frames are nearly the same, so the rows of the last frame estimate the costs
+        vector<TaskScheduler::WorkUnit> units = planner.make_work_units(i, row_iterations, scheduler.get_nr_threads());
+        if (use_bla) {
+            mandelbrot_bla(view.x, view.y, view.height, current_max_its, units);
+        } else {
+            mandelbrot(x_cor, y_cor, current_max_its, units);
+        }
 
-        // main mandelbrot calculation
-        mandelbrot(x_cor, y_cor, current_max_its);
+        // the outputs of the previous frame ran next to the kernel; they have to be done before target_frame is reused
+        for (future<void>& write : target_writes) {
+            write.get();
+        }
+        target_writes.clear();
         X.convertTo(output_image, CV_8UC3, 255.0);
 
-        // adjust the main parameters for the next iteration
-        ips.f_xy *= ips.r_xy;
-        width *= r_dim;
-        height *= r_dim;
+        if (archive) {
+            // the previous frame is written; after a failed write the archive skips the rest
+            if (archive_write.valid()) {
+                archive_write.get();
+            }
+            N.copyTo(archive_iterations);
+            archive_write = scheduler.submit([&archive, &archive_iterations, current_max_its]() {
+                return archive->write_frame(archive_iterations, current_max_its);
+            });
+        }
 
         // Write video and liveplot
         if(render) {
@@ -106,6 +198,19 @@ void MandelbrotVideo::run() {
             // Write the image to the video
             videoWriter.write(output_image);
 
+            // downsample and encode the extra outputs in parallel, overlapping with the next frame,
+            // which renders into the other buffer
+            if (!targets.empty()) {
+                swap(X, target_frame);
+            }
+            for (unique_ptr<OutputTarget>& target : targets) {
+                OutputTarget* t = target.get();
+                cv::Mat frame = target_frame;
+                target_writes.push_back(scheduler.submit([t, i, frame]() {
+                    t->write_frame(i, frame);
+                }));
+            }
+
             if(liveplotting) {
                 cv::imshow("Mandelbrot Liveplot", output_image);
                 cv::waitKey(1);
@@ -119,13 +224,37 @@ void MandelbrotVideo::run() {
         auto end_it = chrono::high_resolution_clock::now();
         double elapsed = chrono::duration_cast<chrono::milliseconds>(end_it - start_it).count() / 1000.0;
 
-        printf("%.2f%% complete, iteration took %.2fs", (static_cast<float>(i + 1) / nr_frames) * 100, elapsed);
+        double frame_iterations = 0;
+        for (long long its : row_iterations) {
+            frame_iterations += its;
+        }
+        planner.add_frame(i, frame_iterations, elapsed);
+
+        printf("%.2f%% complete, iteration took %.2fs, %d rows mirrored, ETA %s", (static_cast<float>(i + 1) / nr_frames) * 100, elapsed,
+            use_bla ? 0 : nr_mirrored_rows, RenderPlanner::format_duration(planner.get_eta_seconds(i + 1)).c_str());
         cout << endl; // to flush
     }
 
     if(render) {
         // Release the video writer
         videoWriter.release();
+
+        for (future<void>& write : target_writes) {
+            write.get();
+        }
+        for (unique_ptr<OutputTarget>& target : targets) {
+            target->close();
+        }
+    }
+
+    if (archive) {
+        // writes the index
+        if (archive_write.valid()) {
+            archive_write.get();
+        }
+        if (!archive->close()) {
+            cerr << "The iteration archive " << iteration_archive << " is incomplete" << endl;
+        }
     }
 
     // End of simulation logging
@@ -133,6 +262,7 @@ void MandelbrotVideo::run() {
     double total_elapsed_seconds = chrono::duration_cast<chrono::milliseconds>(end_simulation - start_simulation).count() / 1000.0;
 
     log_performance(total_elapsed_seconds, render_time/1000.0);
+    scheduler.log_worker_stats();
     printf("Video written successfully! Simulation finished in %.2fs", total_elapsed_seconds);
     cout << endl;
 }
@@ -11,6 +11,9 @@
 #include "settings.hpp"
 #include "mandelbrot.hpp"
 #include "mandelbrot_trajectory.hpp"
+#include "render_planner.hpp"
+#include "iteration_archive.hpp"
+#include "output_target.hpp"
 
 class MandelbrotVideo : public Mandelbrot, Trajectory {
     public:
@@ -20,7 +23,11 @@ class MandelbrotVideo : public Mandelbrot, Trajectory {
             fps(settings->fps), 
             output_filename(settings->output_filename), 
             render(settings->render), 
-            liveplotting(settings->liveplotting) {};
+            liveplotting(settings->liveplotting),
+            iteration_archive(settings->iteration_archive),
+            archive_chunk_rows(settings->archive_chunk_rows),
+            outputs(settings->outputs),
+            planner(settings) {};
 
         void run() override;
 
@@ -30,7 +37,16 @@ class MandelbrotVideo : public Mandelbrot, Trajectory {
         const string output_filename;  
         const bool render;  
         const bool liveplotting;
+        const string iteration_archive;
+        const int archive_chunk_rows;
+        const vector<Settings::Output> outputs;
+        RenderPlanner planner;
+
+        // the colors of the last frame for the extra outputs, swapped with X so the next frame renders into the other buffer
+        FrameAllocator::Buffer target_frame_buffer;
+        cv::Mat target_frame;
         int get_current_max_its(int current_frame_nr);
+        void plan();
         void log_performance(const double total_elapsed_seconds, const double total_render_time, const string& log_filename = "performance_log.csv"); // default arguments are defined in the header, do not use in the cpp file!
 };
 
@@ -0,0 +1,107 @@
+#include "output_target.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "spdlog/spdlog.h"
+
+
+/**
+ * A width or height of 0 follows from the other one and the aspect ratio of the render; both 0 is the full resolution.
+ */
+static int target_width(const Settings::Output& output, int nx, int ny) {
+    if (output.width > 0) {
+        return output.width;
+    }
+    return (output.height > 0) ? max(1, static_cast<int>(lround(output.height * (static_cast<double>(nx) / ny)))) : nx;
+}
+
+static int target_height(const Settings::Output& output, int nx, int ny) {
+    if (output.height > 0) {
+        return output.height;
+    }
+    return (output.width > 0) ? max(1, static_cast<int>(lround(output.width * (static_cast<double>(ny) / nx)))) : ny;
+}
+
+
+OutputTarget::OutputTarget(const Settings::Output& output, int nx, int ny, int fps, int nr_frames, FrameAllocator* allocator) :
+    type(output.type),
+    path(output.path),
+    width(target_width(output, nx, ny)),
+    height(target_height(output, nx, ny)),
+    fps(fps),
+    nr_frames(nr_frames) {
+
+    downsampled = allocator->acquire_mat(height, width, CV_64FC3, frame_buffer);
+    downsampled_image = allocator->acquire_mat(height, width, CV_8UC3, image_buffer);
+
+    if (type == "thumbnails") {
+        // evenly spread, including the first and the last frame
+        int count = max(1, min(output.count, nr_frames));
+        for (int k = 0; k < count; ++k) {
+            thumbnail_frames.push_back((count == 1) ? 0 : static_cast<int>(lround(k * (nr_frames - 1.0) / (count - 1))));
+        }
+    }
+}
+
+
+bool OutputTarget::open() {
+    if (path.empty()) {
+        cerr << "Output of type " << type << " has no path" << endl;
+        return false;
+    }
+
+    if (type == "video") {
+        int codec = cv::VideoWriter::fourcc('m', 'p', '4', 'v');  // Codec for MP4 (using 'MP4V')
+        videoWriter.open(path, codec, fps, cv::Size(width, height), true);
+        if (!videoWriter.isOpened()) {
+            cerr << "Could not open the video writer for " << path << endl;
+            return false;
+        }
+    } else if (type != "thumbnails") {
+        cerr << "Unknown output type " << type << " for " << path << ", expected video or thumbnails" << endl;
+        return false;
+    }
+
+    spdlog::info("Output {} ({}, {}x{})", path, type, width, height);
+    return true;
+}
+
+
+void OutputTarget::write_frame(int frame_nr, const cv::Mat& frame) {
+    bool is_thumbnail = find(thumbnail_frames.begin(), thumbnail_frames.end(), frame_nr) != thumbnail_frames.end();
+    if (type == "thumbnails" && !is_thumbnail) {
+        return;
+    }
+
+    // area average: every pixel of the target is the mean of the pixels of the frame it covers, no aliasing;
+    // averaged before rounding to 8 bit, like the full resolution frame
+    cv::resize(frame, downsampled, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    downsampled.convertTo(downsampled_image, CV_8UC3, 255.0);
+
+    if (type == "video") {
+        videoWriter.write(downsampled_image);
+    } else {
+        thumbnails.push_back(downsampled_image.clone());
+    }
+}
+
+
+void OutputTarget::close() {
+    if (type == "video") {
+        videoWriter.release();
+        return;
+    }
+
+    if (thumbnails.empty()) {
+        return;
+    }
+
+    cv::Mat strip;
+    cv::hconcat(thumbnails, strip);
+    if (!cv::imwrite(path, strip)) {
+        cerr << "Could not write the thumbnails to " << path << endl;
+        return;
+    }
+    spdlog::info("Wrote {} thumbnails to {}", thumbnails.size(), path);
+}
@@ -0,0 +1,54 @@
+#ifndef OUTPUT_TARGET_HPP
+#define OUTPUT_TARGET_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "settings.hpp"
+#include "frame_allocator.hpp"
+
+using namespace std;
+
+/**
+ * An extra output of a video render (see Settings::Output), fed with the frames of the render.
+ * Every frame is downsampled from the colors before quantization (X) with an area average (cv::INTER_AREA)
+ * into a buffer of its own, and only then converted to 8 bit,
+ * so targets can be written in parallel with each other and with the next frame.
+ */
+class OutputTarget {
+    public:
+        OutputTarget(const Settings::Output& output, int nx, int ny, int fps, int nr_frames, FrameAllocator* allocator);
+
+        // open the encoder, false (with a message) if the target cannot be written
+        bool open();
+
+        // downsample frame frame_nr of the render (CV_64FC3 in [0, 1], nx x ny) and encode or keep it
+        void write_frame(int frame_nr, const cv::Mat& frame);
+
+        // release the encoder, or write the thumbnail strip
+        void close();
+
+        const string type;
+        const string path;
+
+    private:
+        const int width;
+        const int height;
+        const int fps;
+        const int nr_frames;
+
+        FrameAllocator::Buffer frame_buffer;
+        FrameAllocator::Buffer image_buffer;
+        cv::Mat downsampled;        // CV_64FC3
+        cv::Mat downsampled_image;  // CV_8UC3
+
+        cv::VideoWriter videoWriter;
+
+        // thumbnails: the frame numbers to keep and the kept frames
+        vector<int> thumbnail_frames;
+        vector<cv::Mat> thumbnails;
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include "render_planner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// a work unit should be worth at least this many iterations (roughly a millisecond), or the queueing overhead shows
+static const double min_unit_iterations = 2e5;
+static const int max_units_per_thread = 16;
+
+
+vector<int> RenderPlanner::get_probe_frames() const {
+    vector<int> frames;
+    int nr = min(max(nr_probes, 2), nr_frames);
+
+    for (int k = 0; k < nr; ++k) {
+        int frame_nr = (nr == 1) ? 0 : static_cast<int>(lround(static_cast<double>(k) * (nr_frames - 1) / (nr - 1)));
+        if (frames.empty() || frames.back() != frame_nr) {
+            frames.push_back(frame_nr);
+        }
+    }
+    return frames;
+}
+
+
+void RenderPlanner::add_probe(int frame_nr, double iterations, double probe_iterations, double probe_seconds, const vector<long long>& row_costs) {
+    probes.emplace_back(frame_nr, iterations);
+    probe_row_costs.emplace_back(frame_nr, row_costs);
+
+    // the probes share the seconds per iteration, so keep the totals in the running sums used as the first guess
+    sum_iterations += probe_iterations;
+    sum_seconds += probe_seconds;
+}
+
+
+void RenderPlanner::fit() {
+    if (probes.empty()) {
+        return;
+    }
+    sort(probes.begin(), probes.end());
+
+    // piecewise linear interpolation of the iterations between the probed frames
+    estimated_iterations.assign(nr_frames, probes.front().second);
+    for (size_t k = 0; k + 1 < probes.size(); ++k) {
+        int f0 = probes[k].first, f1 = probes[k + 1].first;
+        for (int i = f0; i <= f1 && i < nr_frames; ++i) {
+            double t = (f1 == f0) ? 0.0 : static_cast<double>(i - f0) / (f1 - f0);
+            estimated_iterations[i] = probes[k].second * (1 - t) + probes[k + 1].second * t;
+        }
+    }
+    for (int i = probes.back().first; i < nr_frames; ++i) {
+        estimated_iterations[i] = probes.back().second;
+    }
+
+    // first guess from the probes: only the kernel, no fixed costs per frame
+    seconds_per_iteration = (sum_iterations > 0) ? sum_seconds / sum_iterations : 0.0;
+    seconds_per_frame = 0.0;
+
+    // from here on the sums are for the rendered frames
+    sum_seconds = sum_iterations = 0.0;
+}
+
+
+void RenderPlanner::add_frame(int frame_nr, double iterations, double seconds) {
+    double estimate = get_estimated_iterations(frame_nr);
+    if (estimate > 0) {
+        iteration_correction = 0.8 * iteration_correction + 0.2 * (iterations / estimate);
+    }
+
+    nr_measured += 1;
+    sum_iterations += iterations;
+    sum_seconds += seconds;
+    sum_iterations2 += iterations * iterations;
+    sum_iterations_seconds += iterations * seconds;
+
+    double mean_iterations = sum_iterations / nr_measured;
+    double mean_seconds = sum_seconds / nr_measured;
+    double variance = sum_iterations2 / nr_measured - mean_iterations * mean_iterations;
+    double covariance = sum_iterations_seconds / nr_measured - mean_iterations * mean_seconds;
+
+    // least squares once the frames differ enough in cost, otherwise keep the slope and only fit the fixed part
+    if (nr_measured >= 3 && variance > 1e-6 * mean_iterations * mean_iterations && covariance > 0) {
+        seconds_per_iteration = covariance / variance;
+    } else if (seconds_per_iteration <= 0 && mean_iterations > 0) {
+        seconds_per_iteration = mean_seconds / mean_iterations;
+    }
+    seconds_per_frame = max(0.0, mean_seconds - seconds_per_iteration * mean_iterations);
+}
+
+
+double RenderPlanner::get_estimated_iterations(int frame_nr) const {
+    if (frame_nr < 0 || frame_nr >= static_cast<int>(estimated_iterations.size())) {
+        return 0.0;
+    }
+    return estimated_iterations[frame_nr];
+}
+
+
+double RenderPlanner::get_predicted_seconds(int frame_nr) const {
+    return seconds_per_frame + seconds_per_iteration * get_estimated_iterations(frame_nr) * iteration_correction;
+}
+
+
+double RenderPlanner::get_predicted_total_seconds() const {
+    return get_eta_seconds(0);
+}
+
+
+double RenderPlanner::get_eta_seconds(int next_frame_nr) const {
+    // without probes, all frames are assumed to cost the average so far
+    if (estimated_iterations.empty()) {
+        return (nr_measured > 0) ? (sum_seconds / nr_measured) * (nr_frames - next_frame_nr) : 0.0;
+    }
+
+    double eta = 0.0;
+    for (int i = next_frame_nr; i < nr_frames; ++i) {
+        eta += get_predicted_seconds(i);
+    }
+    return eta;
+}
+
+
+vector<TaskScheduler::WorkUnit> RenderPlanner::make_work_units(int frame_nr, const vector<long long>& frame_row_costs, int nr_threads) const {
+    vector<TaskScheduler::WorkUnit> units;
+
+    double total_cost = 0.0;
+    for (long long cost : frame_row_costs) {
+        total_cost += cost;
+    }
+
+    // no frame rendered yet: the probe of this frame has the costs of the rows
+    const vector<long long>* row_costs = &frame_row_costs;
+    if (total_cost <= 0) {
+        for (const pair<int, vector<long long>>& probe : probe_row_costs) {
+            if (probe.first == frame_nr && probe.second.size() == frame_row_costs.size()) {
+                row_costs = &probe.second;
+                for (long long cost : probe.second) {
+                    total_cost += cost;
+                }
+                break;
+            }
+        }
+    }
+    int nr_rows = static_cast<int>(row_costs->size());
+
+    if (total_cost <= 0) {
+        for (int j = 0; j < nr_rows; ++j) {
+            units.push_back({j, j + 1, 1.0});
+        }
+        return units;
+    }
+
+    // the row costs only give the shape; the planner knows better how expensive this frame will be
+    double frame_cost = get_estimated_iterations(frame_nr) * iteration_correction;
+    if (frame_cost <= 0) {
+        frame_cost = total_cost;
+    }
+
+    // cheap frames get fewer, bigger units; expensive frames more, so the last units are small enough to balance
+    int nr_units = static_cast<int>(frame_cost / min_unit_iterations);
+    nr_units = min(max(nr_units, nr_threads), nr_threads * max_units_per_thread);
+    nr_units = min(max(nr_units, 1), max(nr_rows, 1));
+    double unit_cost = total_cost / nr_units;
+
+    // close a unit before it would get too expensive, so an expensive row is not glued to a block of cheap ones
+    int begin = 0;
+    double cost = 0.0;
+    for (int j = 0; j < nr_rows; ++j) {
+        if (j > begin && cost + (*row_costs)[j] > unit_cost) {
+            units.push_back({begin, j, cost});
+            begin = j;
+            cost = 0.0;
+        }
+        cost += (*row_costs)[j];
+    }
+    units.push_back({begin, nr_rows, cost});
+
+    // longest processing time first: the expensive units start early, the cheap ones fill up the gaps
+    stable_sort(units.begin(), units.end(), [](const TaskScheduler::WorkUnit& a, const TaskScheduler::WorkUnit& b) {
+        return a.cost > b.cost;
+    });
+    return units;
+}
+
+
+string RenderPlanner::format_duration(double seconds) {
+    long long total = llround(max(0.0, seconds));
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%lld:%02lld:%02lld", total / 3600, (total / 60) % 60, total % 60);
+    return string(buffer);
+}
@@ -0,0 +1,82 @@
+#ifndef RENDER_PLANNER_HPP
+#define RENDER_PLANNER_HPP
+
+#include <string>
+#include <vector>
+
+#include "settings.hpp"
+#include "task_scheduler.hpp"
+
+using namespace std;
+
+/**
+ * Cost model of a video render, to predict the total time and the ETA, and to size the work units of the kernel.
+ *
+ * Before rendering, a sample of frames is probed at low resolution: this gives the (full resolution)
+ * iterations of every frame by interpolation, and a first seconds per iteration.
+ * During the render, the model is refit on the measured frames:
+ *      seconds(frame) = seconds_per_frame + seconds_per_iteration * iterations(frame)
+ * where the fixed part covers the colorizer, conversion and encoding.
+ */
+class RenderPlanner {
+    public:
+        RenderPlanner(Settings* settings) :
+            enabled(settings->plan_render),
+            nr_probes(settings->planner_probes),
+            probe_scale(settings->planner_probe_scale),
+            nr_frames(settings->nr_frames) {};
+
+        const bool enabled;
+        const int nr_probes;
+        const int probe_scale;  // probes have a resolution of (nx / probe_scale, ny / probe_scale)
+
+        // frame numbers to probe, evenly spread, including the first and the last frame
+        vector<int> get_probe_frames() const;
+
+        // result of a probe: estimated iterations at full resolution, and the seconds the (smaller) probe took for probe_iterations;
+        // row_costs are the estimated iterations of every full resolution row
+        void add_probe(int frame_nr, double iterations, double probe_iterations, double probe_seconds, const vector<long long>& row_costs);
+
+        // after the probes: interpolate the iterations of all frames and set up the model
+        void fit();
+
+        // a frame is rendered: refine the model
+        void add_frame(int frame_nr, double iterations, double seconds);
+
+        double get_estimated_iterations(int frame_nr) const;
+        double get_predicted_seconds(int frame_nr) const;
+        double get_predicted_total_seconds() const;
+        double get_eta_seconds(int next_frame_nr) const;
+
+        /**
+         * Work units for the rows of frame_nr, from the iterations per row of the previous frame:
+         * contiguous rows of roughly equal cost, most expensive first.
+         * The number of units follows from the (corrected) estimated iterations of the frame, or else from the row costs.
+         * Without row costs, the rows of the probe of the frame are used, if it was probed; otherwise every row is a unit.
+         */
+        vector<TaskScheduler::WorkUnit> make_work_units(int frame_nr, const vector<long long>& row_costs, int nr_threads) const;
+
+        static string format_duration(double seconds);
+
+    private:
+        const int nr_frames;
+
+        vector<pair<int, double>> probes;           // frame number, full resolution iterations
+        vector<double> estimated_iterations;        // per frame, empty without probes
+        vector<pair<int, vector<long long>>> probe_row_costs;  // frame number, estimated iterations per row
+
+        double seconds_per_frame = 0.0;
+        double seconds_per_iteration = 0.0;
+
+        // measured / estimated iterations of the rendered frames (moving average), corrects the probe estimates
+        double iteration_correction = 1.0;
+
+        // running sums for the least squares fit of seconds on iterations
+        int nr_measured = 0;
+        double sum_seconds = 0.0;
+        double sum_iterations = 0.0;
+        double sum_iterations2 = 0.0;
+        double sum_iterations_seconds = 0.0;
+};
+
+#endif
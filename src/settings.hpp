@@ -22,16 +22,84 @@ class Settings {
         int nr_frames = 400;
         int max_its = 2000;
 
+        // mirror the rows of a view across the real axis instead of iterating them, only the rows of the linspace that are
+        // exact mirror images, so identical to a full render. symmetry_resample interpolates the other rows of the band,
+        // not identical to a full render; symmetry_snap shifts a view that straddles the axis by up to a quarter row
+        // (Mandelbrot::y_linspace) so all rows of the band mirror exactly, identical to a full render of the shifted view
+        bool conjugate_symmetry = true;
+        bool symmetry_resample = false;
+        bool symmetry_snap = false;
+
+        // perturbation kernel with bivariate linear approximation. It only pays off for still images of views below a height
+        // of about 1e-12, where the escape time kernel loses precision. Video frame centers are doubles interpolated along
+        // the trajectory, so below a height of about 1e-14 consecutive frames jump; the default trajectory ends at 2.7e-13,
+        // where it is not faster than the escape time kernel
+        bool bla = false;
+        double bla_epsilon = 6e-8;  // about 2^-24, relative size of the neglected dz^2 term
+
         bool gpu = true;
         bool animate = true;
         bool render = true;
         bool liveplotting = true;
 
+        // interactive explorer instead of an image or video; 'e' appends the view to explorer_export_file
+        bool interactive = false;
+        string explorer_export_file = "trajectory_points.yaml";
+        int explorer_display_width = 1280;  // the window; renders are downsampled once, previews warped at this size. 0 = x_resolution
+
+        // parallelism; nr_threads = 0 uses all cores
+        int nr_threads = 0;
+        bool pin_threads = false;
+
+        // frame buffer memory; huge_pages is one of "none", "transparent" or "explicit".
+        // numa_first_touch also pins the threads, but only on a machine with more than one NUMA node
+        string huge_pages = "transparent";
+        bool numa_first_touch = true;
+
         string colormap = "twilight";
+        double color_cycle = 255.0;  // iterations per cycle through the colormap
 
         string output_filename = "mandelbrot";
         int fps = 30;
 
+        /**
+         * Extra outputs of a video, downsampled (area average) from the frames of the render:
+         *  - "video": an mp4 at width x height, e.g. a proxy of the master
+         *  - "thumbnails": a png strip of count frames, evenly spread over the video, each width x height
+         * height = 0 keeps the aspect ratio of the render.
+         */
+        struct Output {
+            string type = "video";
+            string path;
+            int width = 0;
+            int height = 0;
+            int count = 10;
+        };
+        vector<Output> outputs;
+
+        // optional archive of the iteration fields of a video (empty = off), input of mandelbrot_recolor
+        string iteration_archive = "";
+        int archive_chunk_rows = 64;
+
+        // planning pass before a video render: probe planner_probes frames at 1/planner_probe_scale of the resolution
+        bool plan_render = true;
+        int planner_probes = 16;
+        int planner_probe_scale = 8;
+
+        // keep the per pixel iteration state of an image, so a render with a higher max_its continues from it
+        bool resume_iterations = false;
+        string iteration_state_file = "mandelbrot_state.bin";
+
+        // kernel regression harness (mandelbrot_regression), golden buffers are rendered by the reference kernel;
+        // the harness reads these from golden/regression.yaml, never from settings.yaml
+        int regression_repeats = 3;
+        string golden_directory = "golden";
+        bool update_golden = false;                 // render the golden buffers again, with the baseline kernel only
+        double regression_max_mismatch = 0.001;     // fraction of pixels
+        double regression_max_mismatch_bla = 0.01;  // perturbation rounds differently, see MandelbrotRegression
+        double regression_max_mismatch_resample = 0.02;   // interpolated rows, a sub-row shift of the mirrored part
+        double regression_max_delta_e = 0.5;        // mean CIE76 delta E
+
         float xy_smoothing_power = 1.25;
 
         double start_height = 3.0;
@@ -53,16 +121,74 @@ class Settings {
                 nr_frames = config["nr_frames"] ? config["nr_frames"].as<int>() : nr_frames;
                 max_its = config["max_its"] ? config["max_its"].as<int>() : max_its;
 
+                // Kernel
+                conjugate_symmetry = config["conjugate_symmetry"] ? config["conjugate_symmetry"].as<bool>() : conjugate_symmetry;
+                symmetry_resample = config["symmetry_resample"] ? config["symmetry_resample"].as<bool>() : symmetry_resample;
+                symmetry_snap = config["symmetry_snap"] ? config["symmetry_snap"].as<bool>() : symmetry_snap;
+                bla = config["bla"] ? config["bla"].as<bool>() : bla;
+                bla_epsilon = config["bla_epsilon"] ? config["bla_epsilon"].as<double>() : bla_epsilon;
+
                 // Flags
                 gpu = config["gpu"] ? config["gpu"].as<bool>() : gpu;
                 animate = config["animate"] ? config["animate"].as<bool>() : animate;
                 render = config["render"] ? config["render"].as<bool>() : render;
                 liveplotting = config["liveplotting"] ? config["liveplotting"].as<bool>() : liveplotting;
+                interactive = config["interactive"] ? config["interactive"].as<bool>() : interactive;
+                explorer_export_file = config["explorer_export_file"] ? config["explorer_export_file"].as<string>() : explorer_export_file;
+                explorer_display_width = config["explorer_display_width"] ? config["explorer_display_width"].as<int>() : explorer_display_width;
+
+                // Parallelism
+                nr_threads = config["nr_threads"] ? config["nr_threads"].as<int>() : nr_threads;
+                pin_threads = config["pin_threads"] ? config["pin_threads"].as<bool>() : pin_threads;
+
+                // Frame buffer memory
+                huge_pages = config["huge_pages"] ? config["huge_pages"].as<string>() : huge_pages;
+                numa_first_touch = config["numa_first_touch"] ? config["numa_first_touch"].as<bool>() : numa_first_touch;
+
+                // Colors
+                colormap = config["colormap"] ? config["colormap"].as<string>() : colormap;
+                color_cycle = config["color_cycle"] ? config["color_cycle"].as<double>() : color_cycle;
 
                 // Filename and fps
                 output_filename = config["output_filename"] ? config["output_filename"].as<string>() : output_filename;
                 fps = config["fps"] ? config["fps"].as<int>() : fps;
 
+                // Extra outputs
+                if (config["outputs"]) {
+                    outputs.clear();
+                    for (const auto& node : config["outputs"]) {
+                        Output output;
+                        output.type = node["type"] ? node["type"].as<string>() : output.type;
+                        output.path = node["path"] ? node["path"].as<string>() : output.path;
+                        output.width = node["width"] ? node["width"].as<int>() : output.width;
+                        output.height = node["height"] ? node["height"].as<int>() : output.height;
+                        output.count = node["count"] ? node["count"].as<int>() : output.count;
+                        outputs.push_back(output);
+                    }
+                }
+
+                // Iteration archive
+                iteration_archive = config["iteration_archive"] ? config["iteration_archive"].as<string>() : iteration_archive;
+                archive_chunk_rows = config["archive_chunk_rows"] ? config["archive_chunk_rows"].as<int>() : archive_chunk_rows;
+
+                // Render planner
+                plan_render = config["plan_render"] ? config["plan_render"].as<bool>() : plan_render;
+                planner_probes = config["planner_probes"] ? config["planner_probes"].as<int>() : planner_probes;
+                planner_probe_scale = config["planner_probe_scale"] ? config["planner_probe_scale"].as<int>() : planner_probe_scale;
+
+                // Resumable iteration state
+                resume_iterations = config["resume_iterations"] ? config["resume_iterations"].as<bool>() : resume_iterations;
+                iteration_state_file = config["iteration_state_file"] ? config["iteration_state_file"].as<string>() : iteration_state_file;
+
+                // Kernel regression
+                regression_repeats = config["regression_repeats"] ? config["regression_repeats"].as<int>() : regression_repeats;
+                golden_directory = config["golden_directory"] ? config["golden_directory"].as<string>() : golden_directory;
+                update_golden = config["update_golden"] ? config["update_golden"].as<bool>() : update_golden;
+                regression_max_mismatch = config["regression_max_mismatch"] ? config["regression_max_mismatch"].as<double>() : regression_max_mismatch;
+                regression_max_mismatch_bla = config["regression_max_mismatch_bla"] ? config["regression_max_mismatch_bla"].as<double>() : regression_max_mismatch_bla;
+                regression_max_mismatch_resample = config["regression_max_mismatch_resample"] ? config["regression_max_mismatch_resample"].as<double>() : regression_max_mismatch_resample;
+                regression_max_delta_e = config["regression_max_delta_e"] ? config["regression_max_delta_e"].as<double>() : regression_max_delta_e;
+
                 // Smoothing and zoom properties
                 xy_smoothing_power = config["xy_smoothing_power"] ? config["xy_smoothing_power"].as<float>() : xy_smoothing_power;
                 start_height = config["start_height"] ? config["start_height"].as<double>() : start_height;
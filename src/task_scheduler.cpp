@@ -0,0 +1,397 @@
+#include "task_scheduler.hpp"
+
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <string>
+
+#include "spdlog/spdlog.h"
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#elif defined(_WIN32)
+    #define NOMINMAX
+    #include <windows.h>
+#endif
+
+// which scheduler and worker the current thread belongs to, used to let nested parallel loops help instead of block
+static thread_local TaskScheduler* current_scheduler = nullptr;
+static thread_local int current_worker = -1;
+
+
+/**
+ * The cores the process is allowed to run on, grouped by NUMA node: those of node 0, then those of node 1, etc.
+ * Only the allowed cores count (the affinity mask, which includes taskset and a cgroup cpuset): pinning to any other fails.
+ * From /sys/devices/system/node/node<n>/cpulist (e.g. "0-7,16-23") on Linux; elsewhere, or without the node directory,
+ * the cores of the affinity mask or else 0 .. nr_cores-1. nr_nodes counts the nodes with at least one allowed core.
+ */
+static vector<int> cores_by_node(int nr_cores, int& nr_nodes) {
+    vector<int> cores;
+    nr_nodes = 0;
+
+#if defined(__linux__)
+    cpu_set_t allowed;
+    bool has_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    auto is_allowed = [&](int core) { return !has_mask || (core >= 0 && core < CPU_SETSIZE && CPU_ISSET(core, &allowed)); };
+
+    for (int node = 0; ; ++node) {
+        ifstream cpulist("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        if (!cpulist) {
+            // node numbers can have gaps after hot unplug, but that is rare enough to stop at the first one missing
+            break;
+        }
+
+        size_t nr_before = cores.size();
+        string range;
+        while (getline(cpulist, range, ',')) {
+            size_t dash = range.find('-');
+            try {
+                int first = stoi(range.substr(0, dash));
+                int last = (dash == string::npos) ? first : stoi(range.substr(dash + 1));
+                for (int core = first; core <= last; ++core) {
+                    if (is_allowed(core)) {
+                        cores.push_back(core);
+                    }
+                }
+            } catch (const exception&) {
+                // an empty list (a node with memory only) or a trailing newline
+            }
+        }
+        nr_nodes += (cores.size() > nr_before) ? 1 : 0;
+    }
+
+    if (cores.empty() && has_mask) {
+        for (int core = 0; core < CPU_SETSIZE; ++core) {
+            if (CPU_ISSET(core, &allowed)) {
+                cores.push_back(core);
+            }
+        }
+    }
+#elif defined(_WIN32)
+    DWORD_PTR process_mask = 0, system_mask = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+        for (int core = 0; core < nr_cores && core < static_cast<int>(8 * sizeof(DWORD_PTR)); ++core) {
+            if (process_mask & (DWORD_PTR(1) << core)) {
+                cores.push_back(core);
+            }
+        }
+    }
+#endif
+
+    if (!cores.empty()) {
+        nr_nodes = max(1, nr_nodes);
+    } else {
+        nr_nodes = 1;
+        for (int core = 0; core < nr_cores; ++core) {
+            cores.push_back(core);
+        }
+    }
+    return cores;
+}
+
+
+TaskScheduler::TaskScheduler(int nr_threads, bool pin_threads, bool numa_first_touch) {
+    int nr_cores = max(1, static_cast<int>(thread::hardware_concurrency()));
+
+    // 0 (or less) means: use all cores
+    if (nr_threads <= 0) {
+        nr_threads = nr_cores;
+    }
+
+    // first create all workers, only then start the threads; they steal from each other
+    for (int w = 0; w < nr_threads; ++w) {
+        workers.push_back(make_unique<Worker>());
+    }
+
+    // consecutive workers (and so contiguous blocks of rows) go to cores of the same node;
+    // first touch needs the workers to stay on their node, which only matters with more than one
+    int nr_nodes = 1;
+    vector<int> cores = (pin_threads || numa_first_touch) ? cores_by_node(nr_cores, nr_nodes) : vector<int>();
+    pin_threads = pin_threads || (numa_first_touch && nr_nodes > 1);
+
+    for (int w = 0; w < nr_threads; ++w) {
+        workers[w]->handle = thread(&TaskScheduler::worker_loop, this, w);
+        if (pin_threads) {
+            pin_to_core(w, cores[(static_cast<long long>(w) * cores.size() / nr_threads) % cores.size()]);
+        }
+    }
+
+    if (pin_threads) {
+        spdlog::info("Pinned {} workers to {} cores on {} NUMA node(s)", nr_threads, cores.size(), nr_nodes);
+    }
+}
+
+
+TaskScheduler::~TaskScheduler() {
+    {
+        lock_guard<mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers) {
+        worker->handle.join();
+    }
+}
+
+
+/*****************
+ * Worker threads
+ *****************/
+
+void TaskScheduler::worker_loop(int worker_id) {
+    current_scheduler = this;
+    current_worker = worker_id;
+
+    while (true) {
+        if (try_run_task(worker_id)) {
+            continue;
+        }
+
+        // nothing to run or steal: sleep until there is a task this worker can take
+        Worker& own = *workers[worker_id];
+        unique_lock<mutex> lock(wake_mutex);
+        if (stopping && nr_stealable_pending.load() == 0 && own.nr_home_pending.load() == 0) {
+            return;
+        }
+        wake.wait(lock, [this, &own] { return stopping || nr_stealable_pending.load() > 0 || own.nr_home_pending.load() > 0; });
+    }
+}
+
+
+/**
+ * Queue a task at the back of the deque of worker_id.
+ * The caller is responsible for waking up the workers.
+ */
+void TaskScheduler::push(int worker_id, function<void()> task, bool stealable) {
+    // count first, so a sleeping worker can never miss the task
+    {
+        lock_guard<mutex> lock(wake_mutex);
+        if (stealable) {
+            nr_stealable_pending.fetch_add(1);
+        } else {
+            workers[worker_id]->nr_home_pending.fetch_add(1);
+        }
+    }
+
+    Worker& worker = *workers[worker_id];
+    lock_guard<mutex> lock(worker.tasks_mutex);
+    if (stealable) {
+        worker.tasks.push_back(move(task));
+    } else {
+        worker.home_tasks.push_back(move(task));
+    }
+}
+
+
+/**
+ * Take a task from our home tasks or the front of our own deque, or else steal one from the back of another worker.
+ * Returns false if there was nothing to run.
+ */
+bool TaskScheduler::try_run_task(int worker_id) {
+    function<void()> task;
+    bool stolen = false;
+    bool home = false;
+    int nr_workers = get_nr_threads();
+
+    {
+        Worker& own = *workers[worker_id];
+        lock_guard<mutex> lock(own.tasks_mutex);
+        if (!own.home_tasks.empty()) {
+            task = move(own.home_tasks.front());
+            own.home_tasks.pop_front();
+            home = true;
+        } else if (!own.tasks.empty()) {
+            task = move(own.tasks.front());
+            own.tasks.pop_front();
+        }
+    }
+
+    // start at the neighbour, so thieves spread over the victims
+    for (int k = 1; !task && k < nr_workers; ++k) {
+        Worker& victim = *workers[(worker_id + k) % nr_workers];
+        lock_guard<mutex> lock(victim.tasks_mutex);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.back());
+            victim.tasks.pop_back();
+            stolen = true;
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+    if (home) {
+        workers[worker_id]->nr_home_pending.fetch_sub(1);
+    } else {
+        nr_stealable_pending.fetch_sub(1);
+    }
+
+    auto start = chrono::steady_clock::now();
+    task();
+    auto end = chrono::steady_clock::now();
+
+    Worker& own = *workers[worker_id];
+    own.tasks_executed.fetch_add(1, memory_order_relaxed);
+    own.tasks_stolen.fetch_add(stolen ? 1 : 0, memory_order_relaxed);
+    own.busy_nanoseconds.fetch_add(chrono::duration_cast<chrono::nanoseconds>(end - start).count(), memory_order_relaxed);
+    return true;
+}
+
+
+void TaskScheduler::pin_to_core(int worker_id, int core) {
+    Worker& worker = *workers[worker_id];
+
+#if defined(__linux__)
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    if (pthread_setaffinity_np(worker.handle.native_handle(), sizeof(cpu_set_t), &cpuset) == 0) {
+        worker.core = core;
+    }
+#elif defined(_WIN32)
+    if (SetThreadAffinityMask(worker.handle.native_handle(), DWORD_PTR(1) << core) != 0) {
+        worker.core = core;
+    }
+#endif
+
+    if (worker.core < 0) {
+        spdlog::warn("Could not pin worker {} to core {}", worker_id, core);
+    }
+}
+
+
+/*******************
+ * Parallel loops
+ *******************/
+
+void TaskScheduler::parallel_for(int begin, int end, int grain, const function<void(int, int)>& body) {
+    grain = max(1, grain);
+
+    vector<WorkUnit> units;
+    units.reserve((end - begin + grain - 1) / grain);
+    for (int unit_begin = begin; unit_begin < end; unit_begin += grain) {
+        units.push_back({unit_begin, min(unit_begin + grain, end), 1.0});
+    }
+
+    run_units(units, begin, end, body);
+}
+
+
+void TaskScheduler::run_units(const vector<WorkUnit>& units, int begin, int end, const function<void(int, int)>& body) {
+    run_job(units, begin, end, body, true);
+}
+
+
+void TaskScheduler::parallel_for_home(int begin, int end, const function<void(int, int)>& body) {
+    int nr_workers = get_nr_threads();
+    long long range = end - begin;
+
+    // exactly the blocks that run_units assigns to each home worker
+    vector<WorkUnit> units;
+    for (int w = 0; w < nr_workers; ++w) {
+        int unit_begin = begin + static_cast<int>((range * w + nr_workers - 1) / nr_workers);
+        int unit_end = begin + static_cast<int>((range * (w + 1) + nr_workers - 1) / nr_workers);
+        if (unit_begin < unit_end) {
+            units.push_back({unit_begin, unit_end, 1.0});
+        }
+    }
+
+    run_job(units, begin, end, body, false);
+}
+
+
+void TaskScheduler::run_job(const vector<WorkUnit>& units, int begin, int end, const function<void(int, int)>& body, bool stealable) {
+    if (units.empty()) {
+        return;
+    }
+
+    // shared between the tasks and this (waiting) thread
+    struct Job {
+        atomic<int> remaining;
+        mutex done_mutex;
+        condition_variable done;
+        exception_ptr error;
+    };
+    auto job = make_shared<Job>();
+    job->remaining = static_cast<int>(units.size());
+
+    int nr_workers = get_nr_threads();
+    long long range = max(1, end - begin);
+
+    for (const WorkUnit& unit : units) {
+        // contiguous blocks of the range belong to the same worker
+        int home = static_cast<int>((static_cast<long long>(unit.begin - begin) * nr_workers) / range);
+        home = min(max(home, 0), nr_workers - 1);
+
+        push(home, [job, &body, unit]() {
+            try {
+                body(unit.begin, unit.end);
+            } catch (...) {
+                lock_guard<mutex> lock(job->done_mutex);
+                if (!job->error) {
+                    job->error = current_exception();
+                }
+            }
+
+            if (job->remaining.fetch_sub(1) == 1) {
+                lock_guard<mutex> lock(job->done_mutex);
+                job->done.notify_all();
+            }
+        }, stealable);
+    }
+    wake.notify_all();
+
+    if (current_scheduler == this) {
+        // nested loop inside a task: help out instead of blocking a worker
+        while (job->remaining.load() > 0) {
+            if (!try_run_task(current_worker)) {
+                this_thread::yield();
+            }
+        }
+    } else {
+        unique_lock<mutex> lock(job->done_mutex);
+        job->done.wait(lock, [&job] { return job->remaining.load() == 0; });
+    }
+
+    if (job->error) {
+        rethrow_exception(job->error);
+    }
+}
+
+
+/*******************
+ * Statistics
+ *******************/
+
+vector<TaskScheduler::WorkerStats> TaskScheduler::get_worker_stats() const {
+    vector<WorkerStats> stats;
+    for (const auto& worker : workers) {
+        stats.push_back({
+            worker->core,
+            worker->tasks_executed.load(),
+            worker->tasks_stolen.load(),
+            worker->busy_nanoseconds.load() / 1e9
+        });
+    }
+    return stats;
+}
+
+
+void TaskScheduler::reset_worker_stats() {
+    for (auto& worker : workers) {
+        worker->tasks_executed = 0;
+        worker->tasks_stolen = 0;
+        worker->busy_nanoseconds = 0;
+    }
+}
+
+
+void TaskScheduler::log_worker_stats() const {
+    vector<WorkerStats> stats = get_worker_stats();
+    for (size_t w = 0; w < stats.size(); ++w) {
+        spdlog::info("worker {} (core {}): {} tasks, {} stolen, busy {:.2f}s",
+            w, stats[w].core, stats[w].tasks_executed, stats[w].tasks_stolen, stats[w].busy_seconds);
+    }
+}
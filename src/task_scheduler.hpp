@@ -0,0 +1,124 @@
+#ifndef TASK_SCHEDULER_HPP
+#define TASK_SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "settings.hpp"
+
+using namespace std;
+
+/**
+ * Work-stealing task pool, replacing the implicit OpenMP parallel for loops.
+ *
+ * Every worker owns a deque of tasks. A worker takes tasks from the front of its own deque
+ * and, when it runs dry, steals from the back of the deque of another worker.
+ * Ranges handed to parallel_for are split in work units which are pushed onto the deque of their 'home' worker:
+ * the range is cut in nr_threads contiguous blocks, so the same rows always go to the same worker first
+ * (and with pinning, the same core; consecutive workers are pinned to the cores of one NUMA node,
+ * out of the cores the process is allowed to run on).
+ * Only the imbalance is resolved by stealing.
+ */
+class TaskScheduler {
+    public:
+        // NUMA first touch only places the pages right if the workers stay on their node,
+        // so on a machine with more than one node it implies pinning
+        TaskScheduler(Settings* settings) : TaskScheduler(settings->nr_threads, settings->pin_threads, settings->numa_first_touch) {};
+        TaskScheduler(int nr_threads, bool pin_threads, bool numa_first_touch = false);
+        ~TaskScheduler();
+
+        // the worker threads keep a pointer to the scheduler, so no copies
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+        // a half open range [begin, end) of a parallel loop, with an (estimated) relative cost
+        struct WorkUnit {
+            int begin;
+            int end;
+            double cost;
+        };
+
+        struct WorkerStats {
+            int core;                   // -1 if not pinned
+            long long tasks_executed;
+            long long tasks_stolen;     // subset of tasks_executed that was taken from another worker
+            double busy_seconds;
+        };
+
+        /**
+         * Run body(unit_begin, unit_end) for all units of size grain in [begin, end), and wait for completion.
+         * The first exception thrown by a unit is rethrown here.
+         */
+        void parallel_for(int begin, int end, int grain, const function<void(int, int)>& body);
+
+        /**
+         * Same as parallel_for, but with work units supplied by the caller, e.g. sized and ordered by an estimated cost.
+         * Units are queued at their home worker in the given order, so put the most expensive first.
+         * begin and end are the bounds of the whole range, used to find the home worker of each unit.
+         */
+        void run_units(const vector<WorkUnit>& units, int begin, int end, const function<void(int, int)>& body);
+
+        /**
+         * One unit per worker, the home block of that worker, which is never stolen.
+         * For work that has to run on the home worker itself, like the NUMA first touch of a buffer.
+         */
+        void parallel_for_home(int begin, int end, const function<void(int, int)>& body);
+
+        // Run a single task asynchronously, e.g. a pipeline stage. Do not block on the future from within a task.
+        template <typename F>
+        auto submit(F&& f) -> future<decltype(f())> {
+            using R = decltype(f());
+            auto task = make_shared<packaged_task<R()>>(std::forward<F>(f));
+            future<R> result = task->get_future();
+
+            int worker_id = next_submit_worker.fetch_add(1, memory_order_relaxed) % get_nr_threads();
+            push(worker_id, [task]() { (*task)(); });
+            wake.notify_one();
+            return result;
+        };
+
+        int get_nr_threads() const { return static_cast<int>(workers.size()); };
+        vector<WorkerStats> get_worker_stats() const;
+        void reset_worker_stats();
+        void log_worker_stats() const;
+
+    private:
+        struct Worker {
+            thread handle;
+            int core = -1;
+
+            mutex tasks_mutex;
+            deque<function<void()>> tasks;
+            deque<function<void()>> home_tasks;  // invisible to thieves
+            atomic<int> nr_home_pending{0};
+
+            atomic<long long> tasks_executed{0};
+            atomic<long long> tasks_stolen{0};
+            atomic<long long> busy_nanoseconds{0};
+        };
+
+        vector<unique_ptr<Worker>> workers;
+        atomic<int> next_submit_worker{0};
+
+        // queued stealable tasks that are not picked up yet; a worker sleeps on wake while this and its own nr_home_pending are zero.
+        // Home tasks are counted per worker: only their owner can run them, so they must not keep the others awake
+        atomic<int> nr_stealable_pending{0};
+        bool stopping = false;
+        mutex wake_mutex;
+        condition_variable wake;
+
+        void worker_loop(int worker_id);
+        void push(int worker_id, function<void()> task, bool stealable = true);
+        void run_job(const vector<WorkUnit>& units, int begin, int end, const function<void(int, int)>& body, bool stealable);
+        bool try_run_task(int worker_id);
+        void pin_to_core(int worker_id, int core);
+};
+
+#endif